@@ -0,0 +1,281 @@
+/**
+ * @file audio.cpp
+ * @author Carl Edwards
+ *
+ * Speaker sound, see audio.h.
+ */
+
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+#include "audio.h"
+#include "pacer.h"
+
+using namespace std;
+
+// DC blocker pole, a corner of ~40 Hz at 48 kHz
+#define DC_BLOCKER_POLE 0.995
+
+// band-limited step table: points per sample, and the cutoff of the
+// sinc as a share of the sample rate (just under Nyquist, the Blackman
+// window's transition band takes the rest)
+#define BLEP_PHASES 64
+#define BLEP_CUTOFF 0.45
+#define BLEP_POINTS (2 * BLEP_WIDTH * BLEP_PHASES + 1)
+
+/*
+ * The band-limited unit step from -BLEP_WIDTH to +BLEP_WIDTH samples
+ * around the edge: the running integral of a Blackman windowed sinc,
+ * scaled to end at exactly 1.
+ */
+struct BlepTable {
+    double step[BLEP_POINTS];
+    BlepTable();
+};
+
+static double blep_impulse(double x) {
+    double sinc = x == 0 ? 2 * BLEP_CUTOFF : sin(2 * numbers::pi * BLEP_CUTOFF * x) / (numbers::pi * x);
+    double window = 0.42 + 0.5 * cos(numbers::pi * x / BLEP_WIDTH) + 0.08 * cos(2 * numbers::pi * x / BLEP_WIDTH);
+    return sinc * window;
+}
+
+BlepTable::BlepTable() {
+    step[0] = 0;
+    double previous = blep_impulse(-BLEP_WIDTH);
+    for (int i = 1; i < BLEP_POINTS; i++) {
+        double impulse = blep_impulse(-BLEP_WIDTH + (double)i / BLEP_PHASES);
+        step[i] = step[i - 1] + (previous + impulse) / (2 * BLEP_PHASES);
+        previous = impulse;
+    }
+    double total = step[BLEP_POINTS - 1];
+    for (int i = 0; i < BLEP_POINTS; i++) {
+        step[i] /= total;
+    }
+}
+
+static const BlepTable blep_table;
+
+// the step 'x' samples after the edge, -BLEP_WIDTH < x < BLEP_WIDTH
+static inline double blep_step(double x) {
+    double position = (x + BLEP_WIDTH) * BLEP_PHASES;
+    int i = (int)position;
+    double f = position - i;
+    return blep_table.step[i] + f * (blep_table.step[i + 1] - blep_table.step[i]);
+}
+
+Speaker::Speaker(int sample_rate) {
+    if (sample_rate <= 0) {
+        throw runtime_error("bad sample rate: " + to_string(sample_rate));
+    }
+    cycles_per_sample_ = (double)MERLIN_INSTRUCTIONS_PER_SECOND / sample_rate;
+    overruns_ = 0;
+    reset(0, 0);
+}
+
+int Speaker::get_sample_rate() {
+    return MERLIN_INSTRUCTIONS_PER_SECOND / cycles_per_sample_ + 0.5;
+}
+
+void Speaker::reset(unsigned long long cycle, int o) {
+    origin_ = cycle;
+    made_ = 0;
+    at_ = cycle;
+    level_ = o & SPEAKER_O_BIT ? 1 : 0;
+    memset(blep_, 0, sizeof blep_);
+    // start settled on the current level, no click
+    dc_in_ = level_ * SPEAKER_AMPLITUDE;
+    dc_out_ = 0;
+    head_ = 0;
+    tail_ = 0;
+}
+
+void Speaker::emit(double level) {
+    double in = level * SPEAKER_AMPLITUDE;
+    dc_out_ = in - dc_in_ + DC_BLOCKER_POLE * dc_out_;
+    dc_in_ = in;
+    double out = dc_out_ < -32767 ? -32767 : dc_out_ > 32767 ? 32767 : dc_out_;
+    if (head_ - tail_ == AUDIO_RING_SAMPLES) {
+        // the host is behind, the oldest sample goes
+        tail_++;
+        overruns_++;
+    }
+    ring_[head_ % AUDIO_RING_SAMPLES] = (short)(out < 0 ? out - 0.5 : out + 0.5);
+    head_++;
+    made_++;
+}
+
+/*
+ * Makes every sample no edge before 'cycle' can still reach: the ones
+ * more than BLEP_WIDTH samples back.
+ */
+void Speaker::render(unsigned long long cycle) {
+    while (origin_ + (made_ + BLEP_WIDTH) * cycles_per_sample_ <= cycle) {
+        double &slot = blep_[made_ % BLEP_SLOTS];
+        emit(level_ + slot);
+        slot = 0;
+    }
+    at_ = cycle;
+}
+
+/*
+ * The level goes to 'level' at 'cycle'. level_ jumps at once, the samples
+ * within BLEP_WIDTH of the edge get the difference to the band-limited
+ * step on top. None of them has been made yet.
+ */
+void Speaker::edge(unsigned long long cycle, int level) {
+    render(cycle);
+    double t = (cycle - origin_) / cycles_per_sample_;
+    double delta = level - level_;
+    for (unsigned long long n = made_; n < t + BLEP_WIDTH; n++) {
+        // render() leaves made_ just past t - BLEP_WIDTH, up to rounding
+        double x = n - t;
+        double step = x > -BLEP_WIDTH ? blep_step(x) : 0;
+        blep_[n % BLEP_SLOTS] += delta * (step - 1);
+    }
+    level_ = level;
+}
+
+/*
+ * O writes come in cycle order, a cycle that goes backwards is a
+ * restored save state and starts the sound over.
+ */
+void Speaker::output_o(unsigned long long cycle, int val) {
+    if (cycle < at_) {
+        reset(cycle, val);
+        return;
+    }
+    int level = val & SPEAKER_O_BIT ? 1 : 0;
+    if (level != level_) {
+        edge(cycle, level);
+    }
+}
+
+void Speaker::output(const OutputEvent *events, int count) {
+    for (int i = 0; i < count; i++) {
+        if (events[i].type == OUTPUT_O) {
+            output_o(events[i].cycle, events[i].value);
+        }
+    }
+}
+
+void Speaker::advance(unsigned long long cycle) {
+    if (cycle > at_) {
+        render(cycle);
+    }
+}
+
+unsigned long Speaker::available() {
+    return head_ - tail_;
+}
+
+unsigned long Speaker::read(short *samples, unsigned long count) {
+    if (count > available()) {
+        count = available();
+    }
+    // in up to two pieces, the ring may wrap
+    unsigned long start = tail_ % AUDIO_RING_SAMPLES;
+    unsigned long first = min(count, AUDIO_RING_SAMPLES - start);
+    memcpy(samples, ring_ + start, first * sizeof(short));
+    memcpy(samples + first, ring_, (count - first) * sizeof(short));
+    tail_ += count;
+    return count;
+}
+
+unsigned long long Speaker::get_overruns() {
+    return overruns_;
+}
+
+bool Speaker::read_block(short *block) {
+    if (available() < AUDIO_BLOCK_SAMPLES) {
+        return false;
+    }
+    read(block, AUDIO_BLOCK_SAMPLES);
+    return true;
+}
+
+/*
+ * RIFF WAV header, little endian like the hosts this runs on.
+ */
+struct WavHeader {
+    char riff[4];
+    unsigned int riff_size;         // file size - 8
+    char wave[4];
+    char fmt[4];
+    unsigned int fmt_size;
+    unsigned short format;          // 1, PCM
+    unsigned short channels;
+    unsigned int sample_rate;
+    unsigned int byte_rate;
+    unsigned short block_align;
+    unsigned short bits;
+    char data[4];
+    unsigned int data_size;
+};
+
+static_assert(sizeof(WavHeader) == 44, "WavHeader has padding holes");
+
+WavWriter::WavWriter(string filename, int sample_rate) {
+    filename_ = filename;
+    samples_ = 0;
+    file_.open(filename, ios::binary | ios::out | ios::trunc);
+    if (!file_.is_open()) {
+        throw runtime_error("error opening file: " + filename);
+    }
+    write_header(sample_rate);
+}
+
+WavWriter::~WavWriter() {
+    try {
+        close();
+    } catch (...) {
+        // nothing to be done about a failed write here
+    }
+}
+
+void WavWriter::write_header(int sample_rate) {
+    WavHeader header;
+    memcpy(header.riff, "RIFF", 4);
+    header.riff_size = sizeof header - 8;
+    memcpy(header.wave, "WAVE", 4);
+    memcpy(header.fmt, "fmt ", 4);
+    header.fmt_size = 16;
+    header.format = 1;
+    header.channels = 1;
+    header.sample_rate = sample_rate;
+    header.byte_rate = sample_rate * sizeof(short);
+    header.block_align = sizeof(short);
+    header.bits = 16;
+    memcpy(header.data, "data", 4);
+    header.data_size = 0;
+    file_.write((const char *)&header, sizeof header);
+    if (!file_) {
+        throw runtime_error("error writing file: " + filename_);
+    }
+}
+
+void WavWriter::write(const short *samples, unsigned long count) {
+    file_.write((const char *)samples, count * sizeof(short));
+    samples_ += count;
+    if (!file_) {
+        throw runtime_error("error writing file: " + filename_);
+    }
+}
+
+void WavWriter::close() {
+    if (!file_.is_open()) {
+        return;
+    }
+    unsigned int data_size = samples_ * sizeof(short);
+    unsigned int riff_size = sizeof(WavHeader) - 8 + data_size;
+    file_.seekp(offsetof(WavHeader, riff_size));
+    file_.write((const char *)&riff_size, sizeof riff_size);
+    file_.seekp(offsetof(WavHeader, data_size));
+    file_.write((const char *)&data_size, sizeof data_size);
+    file_.close();
+    if (!file_) {
+        throw runtime_error("error writing file: " + filename_);
+    }
+}
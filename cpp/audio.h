@@ -0,0 +1,120 @@
+/**
+ * @file audio.h
+ * @author Carl Edwards
+ *
+ * Speaker sound for the TMS1100 C++ library.
+ *
+ * Merlin drives its speaker straight from O0, the game makes every sound
+ * by toggling that bit. Speaker takes the O output with the cycle of each
+ * write and turns the square wave into 16 bit mono PCM at a host sample
+ * rate. Every edge is drawn as a band-limited step (BLEP): a windowed
+ * sinc integrated into a table, placed at the edge's exact position
+ * between samples. The square wave's harmonics above the Nyquist rate
+ * are filtered out rather than folding back as audible aliases. A DC
+ * blocker follows, so a silent game gives silence whichever way the bit
+ * was left.
+ *
+ * A step reaches BLEP_WIDTH samples either side of its edge, so samples
+ * lag the cycle the host has advance()d to by that much. They are only
+ * made up to that point and
+ * are buffered until the host pulls them, as whole blocks for an audio
+ * device or all at once for WavWriter. The buffer holds AUDIO_RING_BLOCKS
+ * blocks, a host that falls further behind loses the oldest samples
+ * (counted by get_overruns()) rather than the buffer growing.
+ */
+#ifndef AUDIO_H
+#define AUDIO_H
+
+#include <string>
+#include <fstream>
+#include "tms1xx0.h"
+
+#define AUDIO_SAMPLE_RATE 48000
+#define AUDIO_BLOCK_SAMPLES 512
+// samples buffered for the host, ~340 ms at 48 kHz
+#define AUDIO_RING_BLOCKS 32
+#define AUDIO_RING_SAMPLES (AUDIO_RING_BLOCKS * AUDIO_BLOCK_SAMPLES)
+
+// the O bit wired to the speaker
+#define SPEAKER_O_BIT 0x01
+
+// peak level of the speaker, leaves headroom for the DC blocker and the
+// ringing of the band-limited edges
+#define SPEAKER_AMPLITUDE 12000
+
+// samples a band-limited step reaches either side of its edge
+#define BLEP_WIDTH 8
+// samples the steps are collected over, a power of 2 above 2 * BLEP_WIDTH
+#define BLEP_SLOTS 32
+
+class Speaker {
+    private:
+    double cycles_per_sample_;
+    double origin_;                 // cycle sample 0 is at
+    unsigned long long made_;       // samples made since origin_
+    unsigned long long at_;         // cycle rendered up to
+    int level_;
+    // what the steps around the next samples add to level_, slot
+    // n % BLEP_SLOTS for sample n
+    double blep_[BLEP_SLOTS];
+    double dc_in_;                  // DC blocker state
+    double dc_out_;
+    short ring_[AUDIO_RING_SAMPLES];
+    unsigned long long head_;       // samples put in ring_
+    unsigned long long tail_;       // samples taken out of ring_
+    unsigned long long overruns_;   // samples dropped on a full ring_
+
+    void render(unsigned long long cycle);
+    void edge(unsigned long long cycle, int level);
+    void emit(double level);
+
+    public:
+    Speaker(int sample_rate = AUDIO_SAMPLE_RATE);
+
+    int get_sample_rate();
+
+    // start over at 'cycle' with O at 'o', drops the buffered samples
+    void reset(unsigned long long cycle, int o);
+
+    // O output as TMS1100 reports it, with the cycle of the write
+    void output_o(unsigned long long cycle, int val);
+    void output(const OutputEvent *events, int count);
+
+    // make the samples up to 'cycle' (less BLEP_WIDTH), call after the cpu
+    // has run
+    void advance(unsigned long long cycle);
+
+    // buffered samples, at most AUDIO_RING_SAMPLES
+    unsigned long available();
+    // up to 'count' buffered samples, returns how many
+    unsigned long read(short *samples, unsigned long count);
+    // one AUDIO_BLOCK_SAMPLES block, false (and nothing taken) if there
+    // isn't a whole block yet
+    bool read_block(short *block);
+
+    // samples dropped since the Speaker was made because the host didn't
+    // read them in time
+    unsigned long long get_overruns();
+};
+
+/*
+ * 16 bit mono PCM WAV file, the sizes in the header are filled in by
+ * close().
+ */
+class WavWriter {
+    private:
+    std::string filename_;
+    std::ofstream file_;
+    unsigned long samples_;
+
+    void write_header(int sample_rate);
+
+    public:
+    WavWriter(std::string filename, int sample_rate);
+    ~WavWriter();
+
+    void write(const short *samples, unsigned long count);
+    void close();
+};
+
+#endif
@@ -0,0 +1,426 @@
+/**
+ * @file bench.cpp
+ * @author Carl Edwards
+ *
+ * Headless throughput benchmark for the TMS1100 C++ library.
+ *
+ * Runs the Merlin ROM for a fixed number of instructions while a scripted
+ * key sequence is fed through the K input port. All output is
+ * discarded; the benchmark reports instructions/second, ns/instruction
+ * and callbacks/second as min/median/max over repeated runs.
+ *
+ * Compiling:
+ *   /usr/bin/clang++ -std=c++2a -O2 tms1xx0.cpp pacer.cpp rewind.cpp bench.cpp -o merlin_bench
+ *
+ * Usage:
+ *   merlin_bench [-n instructions] [-r repeats] [-b batch] [--step] [--rewind] [--instances n] [--fetch [masked|checked|both]] [rom]
+ *     -n  instructions per run (default 10000000)
+ *     -r  number of runs (default 5)
+ *     -b  instructions per run() call (default 100000)
+ *     --step  call step() once per instruction instead of run()
+ *     --rewind  run through a Rewind buffer and report its memory use
+ *               and seek latency
+ *     --instances  run n independent TMS1100s round robin, -b instructions
+ *                  each per turn, after checking every instance against
+ *                  step(). -n is the total over all instances.
+ *     --fetch  time -n ROM fetches on their own, at the addresses the game
+ *              fetches from. An optional 'masked' (get_instruction()),
+ *              'checked' (the bounds checked fetch it replaced) or 'both'
+ *              (the default) picks the fetch.
+ *
+ * Many machines on one core are best run as separate TMS1100s. A lockstep
+ * structure-of-arrays engine (every register an array over the lanes,
+ * lanes at the same address executed together with masked loops) was
+ * tried and dropped: each distinct address in a step costs a pass over
+ * all lanes, and lanes with their own K input spread over ~25 addresses
+ * within a few thousand instructions. Such lanes ran at 7-33M
+ * instructions/s (-O2 to -O3 -march=native) against 130-260M for
+ * --instances 64. Lanes fed the same input, which makes them identical,
+ * reached 100-300M, still no better than one TMS1100.
+ */
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include "tms1xx0.h"
+#include "pacer.h"
+#include "rewind.h"
+
+using namespace std;
+
+/*
+ * Scripted input: every KEY_PERIOD K reads the next key of the script is
+ * held down for KEY_HOLD K reads, same as the console front end does.
+ */
+#define KEY_PERIOD 2000
+#define KEY_HOLD 32
+
+struct ScriptKey {
+    int o_reg;
+    int k_val;
+};
+
+// '~', 1 - 9, 0, same game, comp turn, new game, hit me
+static ScriptKey key_script[] = {
+    {0, 1}, {0, 2}, {0, 8}, {0, 4},
+    {4, 1}, {4, 2}, {4, 8}, {4, 4},
+    {8, 1}, {8, 2}, {8, 8}, {8, 4},
+    {12, 2}, {12, 8}, {12, 4}
+};
+
+/*
+ * Discards the output and plays the key script, bound to the cpu with
+ * bind_io().
+ */
+class ScriptedHost {
+    public:
+    unsigned long r_count;
+    unsigned long o_count;
+    unsigned long k_count;
+
+    // 'offset' shifts the script so hosts can be told apart
+    ScriptedHost(unsigned long offset = 0) {
+        r_count = o_count = 0;
+        k_count = offset;
+    }
+
+    void output_r(int, bool) {
+        r_count++;
+    }
+
+    void output_o(int) {
+        o_count++;
+    }
+
+    int input_k(int o_reg) {
+        unsigned long read = k_count++;
+        const ScriptKey &key = key_script[(read / KEY_PERIOD) % (sizeof(key_script) / sizeof key_script[0])];
+        if (read % KEY_PERIOD < KEY_HOLD && o_reg == key.o_reg) {
+            return key.k_val;
+        }
+        return 0;
+    }
+};
+
+void report(const char *name, vector<double> values) {
+    sort(values.begin(), values.end());
+    printf("%-16s min %14.2f  median %14.2f  max %14.2f\n", name,
+        values.front(), values[values.size() / 2], values.back());
+}
+
+/*
+ * Seeks back by random amounts within the window and replays forward again.
+ */
+void report_rewind(Rewind *rewind) {
+    double seconds = rewind->get_window_cycles() / (double)MERLIN_INSTRUCTIONS_PER_SECOND;
+    printf("rewind: %lu frames, %lu K changes, %lu bytes for %.1f s (%.0f bytes/s)\n",
+        rewind->get_frames(), rewind->get_k_changes(), rewind->get_memory(), seconds,
+        rewind->get_memory() / seconds);
+
+    srand(1);
+    for (int i = 0; i < 100; i++) {
+        unsigned long long back = rand() % (rewind->get_window_cycles() + 1);
+        rewind->rewind(back);
+        rewind->run(back);
+    }
+    printf("rewind: seek latency last %.1f us, max %.1f us\n", rewind->get_last_seek_us(),
+        rewind->get_max_seek_us());
+}
+
+/*
+ * Every instance plays the key script from a different offset, so they
+ * drift apart as independent players would.
+ */
+#define INSTANCE_OFFSET 977
+
+// instructions every instance is checked against TMS1100::step() for
+#define INSTANCE_VERIFY_CYCLES 200000
+
+ScriptedHost *instance_hosts(int count) {
+    ScriptedHost *hosts = new ScriptedHost[count];
+    for (int i = 0; i < count; i++) {
+        hosts[i] = ScriptedHost(i * INSTANCE_OFFSET);
+    }
+    return hosts;
+}
+
+/*
+ * Runs the instances round robin next to a twin of each that only
+ * step()s, and compares the whole machine state after every turn.
+ */
+bool verify_instances(ROM *rom, int count, unsigned long batch) {
+    ScriptedHost *hosts = instance_hosts(count);
+    ScriptedHost *twin_hosts = instance_hosts(count);
+    vector<TMS1100 *> cpus, twins;
+    for (int i = 0; i < count; i++) {
+        cpus.push_back(new TMS1100(rom));
+        cpus[i]->set_io(bind_io(&hosts[i]));
+        twins.push_back(new TMS1100(rom));
+        twins[i]->set_io(bind_io(&twin_hosts[i]));
+    }
+
+    bool ok = true;
+    for (unsigned long done = 0; done < INSTANCE_VERIFY_CYCLES && ok; ) {
+        unsigned long turn = min(batch, INSTANCE_VERIFY_CYCLES - done);
+        for (int i = 0; i < count && ok; i++) {
+            cpus[i]->run(turn);
+            for (unsigned long n = 0; n < turn; n++) {
+                twins[i]->step();
+            }
+            MachineState expected, actual;
+            twins[i]->save_state(expected);
+            cpus[i]->save_state(actual);
+            if (memcmp(&expected, &actual, sizeof expected) != 0) {
+                printf("instances: instance %d differs from step() after %lu instructions\n", i, done + turn);
+                ok = false;
+            }
+        }
+        done += turn;
+    }
+    if (ok) {
+        printf("instances: %d instances match step() for %d instructions\n", count, INSTANCE_VERIFY_CYCLES);
+    }
+    for (int i = 0; i < count; i++) {
+        delete cpus[i];
+        delete twins[i];
+    }
+    delete[] hosts;
+    delete[] twin_hosts;
+    return ok;
+}
+
+/*
+ * Many separate machines, as a server hosting lots of sessions would run
+ * them. Once the machines no longer fit in the caches this measures the
+ * cost of bringing each one's state back in.
+ */
+void bench_instances(ROM *rom, int count, unsigned long instructions, unsigned long batch, int repeats) {
+    unsigned long turns = max(instructions / ((unsigned long)count * batch), 1UL);
+    vector<double> ips, ns;
+    for (int i = 0; i < repeats; i++) {
+        ScriptedHost *hosts = instance_hosts(count);
+        vector<TMS1100 *> cpus;
+        for (int j = 0; j < count; j++) {
+            cpus.push_back(new TMS1100(rom));
+            cpus[j]->set_io(bind_io(&hosts[j]));
+        }
+
+        auto start = chrono::steady_clock::now();
+        for (unsigned long t = 0; t < turns; t++) {
+            for (int j = 0; j < count; j++) {
+                cpus[j]->run(batch);
+            }
+        }
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+        unsigned long total = turns * count * batch;
+        ips.push_back(total / elapsed.count());
+        ns.push_back(elapsed.count() * 1e9 / total);
+
+        for (int j = 0; j < count; j++) {
+            delete cpus[j];
+        }
+        delete[] hosts;
+    }
+    printf("instances: %d x %lu turns of %lu instructions x %d runs, sizeof(TMS1100) %zu\n",
+        count, turns, batch, repeats, sizeof(TMS1100));
+    report("instructions/s", ips);
+    report("ns/instruction", ns);
+}
+
+/*
+ * The fetch step() does, replayed from a recorded address trace that fits
+ * in L1 so only the fetch itself is measured.
+ */
+#define FETCH_ADDRESSES 4096
+
+// ns per fetch, every fetch depends on the one before as it does in step()
+template <bool CHECKED>
+double time_fetch(ROM *rom, const vector<WORD> &addresses, unsigned long rounds, unsigned long &sum) {
+    auto start = chrono::steady_clock::now();
+    int j = 0;
+    for (unsigned long n = 0; n < rounds * FETCH_ADDRESSES; n++) {
+        const Instruction &ins = CHECKED ? rom->get_instruction_checked(addresses[j])
+            : rom->get_instruction(addresses[j]);
+        sum += ins.op;
+        j = (j + ins.len) & (FETCH_ADDRESSES - 1);
+    }
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    return elapsed.count() * 1e9 / (rounds * FETCH_ADDRESSES);
+}
+
+/*
+ * 'variant' is "masked" (get_instruction()), "checked" (the bounds
+ * checked fetch it replaced) or "both", which alternates the two run by
+ * run so they see the same machine state.
+ */
+void bench_fetch(ROM *rom, unsigned long instructions, int repeats, string variant) {
+    TMS1100 emu = TMS1100(rom);
+    ScriptedHost host;
+    emu.set_io(bind_io(&host));
+    vector<WORD> addresses;
+    for (int i = 0; i < FETCH_ADDRESSES; i++) {
+        MachineState state;
+        emu.save_state(state);
+        addresses.push_back((state.ca << 10) | (state.pa << 6) | state.pc);
+        emu.step();
+    }
+
+    unsigned long rounds = max(instructions / FETCH_ADDRESSES, 1UL);
+    vector<double> masked, checked;
+    unsigned long sum = 0;
+    for (int i = 0; i < repeats; i++) {
+        if (variant != "checked") {
+            masked.push_back(time_fetch<false>(rom, addresses, rounds, sum));
+        }
+        if (variant != "masked") {
+            checked.push_back(time_fetch<true>(rom, addresses, rounds, sum));
+        }
+    }
+    printf("fetch: %lu fetches x %d runs (checksum %lu)\n", rounds * FETCH_ADDRESSES, repeats, sum);
+    if (!masked.empty()) {
+        report("ns/fetch masked", masked);
+    }
+    if (!checked.empty()) {
+        report("ns/fetch checked", checked);
+    }
+}
+
+struct Result {
+    double seconds;
+    unsigned long callbacks;
+};
+
+Result run_once(ROM *rom, unsigned long instructions, unsigned long batch, bool use_step, bool use_rewind) {
+    TMS1100 emu = TMS1100(rom);
+    ScriptedHost host;
+    emu.set_io(bind_io(&host));
+    Rewind *rewind = use_rewind ? new Rewind(&emu, bind_io(&host)) : NULL;
+
+    auto start = chrono::steady_clock::now();
+    if (use_step) {
+        for (unsigned long i = 0; i < instructions; i++) {
+            emu.step();
+        }
+    }
+    else {
+        unsigned long done = 0;
+        while (done < instructions) {
+            if (rewind) {
+                done += rewind->run(min(batch, instructions - done));
+            }
+            else {
+                done += emu.run(min(batch, instructions - done));
+            }
+        }
+    }
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+    Result result;
+    result.seconds = elapsed.count();
+    result.callbacks = host.r_count + host.o_count + host.k_count;
+
+    if (rewind) {
+        report_rewind(rewind);
+        delete rewind;
+    }
+    return result;
+}
+
+int main(int argc, char **argv) {
+    unsigned long instructions = 10000000;
+    unsigned long batch = 100000;
+    int repeats = 5;
+    bool use_step = false;
+    bool use_rewind = false;
+    int instances = 0;
+    bool use_fetch = false;
+    string fetch_variant = "both";
+    string rom_filename = "mp3404.bin";
+
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "-n" && i + 1 < argc) {
+            instructions = strtoul(argv[++i], NULL, 0);
+        }
+        else if (arg == "-r" && i + 1 < argc) {
+            repeats = atoi(argv[++i]);
+        }
+        else if (arg == "-b" && i + 1 < argc) {
+            batch = strtoul(argv[++i], NULL, 0);
+        }
+        else if (arg == "--step") {
+            use_step = true;
+        }
+        else if (arg == "--rewind") {
+            use_rewind = true;
+        }
+        else if (arg == "--instances" && i + 1 < argc) {
+            instances = atoi(argv[++i]);
+        }
+        else if (arg == "--fetch") {
+            use_fetch = true;
+            if (i + 1 < argc) {
+                string next = argv[i + 1];
+                if (next == "masked" || next == "checked" || next == "both") {
+                    fetch_variant = next;
+                    i++;
+                }
+            }
+        }
+        else if (arg[0] != '-') {
+            rom_filename = arg;
+        }
+        else {
+            cout << "usage: " << argv[0] << " [-n instructions] [-r repeats] [-b batch] [--step] [--rewind] [--instances n] [--fetch [masked|checked|both]] [rom]" << endl;
+            return 1;
+        }
+    }
+    if (instructions == 0 || batch == 0 || repeats <= 0) {
+        cout << "instructions, batch and repeats must be greater than 0" << endl;
+        return 1;
+    }
+    if (use_step && use_rewind) {
+        cout << "--step and --rewind can't be combined" << endl;
+        return 1;
+    }
+
+    try {
+        ROM *rom = new ROM();
+        rom->load_rom(rom_filename);
+
+        if (use_fetch) {
+            bench_fetch(rom, instructions, repeats, fetch_variant);
+            delete rom;
+            return 0;
+        }
+        if (instances > 0) {
+            if (!verify_instances(rom, instances, batch)) {
+                return 1;
+            }
+            bench_instances(rom, instances, instructions, batch, repeats);
+            delete rom;
+            return 0;
+        }
+
+        vector<double> ips, ns, cps;
+        for (int i = 0; i < repeats; i++) {
+            Result result = run_once(rom, instructions, batch, use_step, use_rewind);
+            ips.push_back(instructions / result.seconds);
+            ns.push_back(result.seconds * 1e9 / instructions);
+            cps.push_back(result.callbacks / result.seconds);
+        }
+
+        printf("%s: %lu instructions x %d runs (%s)\n", rom_filename.c_str(), instructions, repeats,
+            use_step ? "step" : use_rewind ? "run with rewind" : "run");
+        report("instructions/s", ips);
+        report("ns/instruction", ns);
+        report("callbacks/s", cps);
+        delete rom;
+    } catch(runtime_error &re) {
+        cout << "unexpected error: " << re.what() << endl;
+        return 1;
+    }
+}
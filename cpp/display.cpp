@@ -0,0 +1,117 @@
+/**
+ * @file display.cpp
+ * @author Carl Edwards
+ *
+ * Frame based LED display model, see display.h.
+ */
+
+#include <cstring>
+#include <stdexcept>
+#include "display.h"
+#include "pacer.h"
+
+LedDisplay::LedDisplay(double frame_rate) {
+    memset(&frame_, 0, sizeof frame_);
+    memset(shown_, 0, sizeof shown_);
+    frame_cycles_ = 1;
+    r_ = 0;
+    last_cycle_ = 0;
+    set_frame_rate(frame_rate);
+}
+
+void LedDisplay::set_frame_rate(double frame_rate) {
+    if (!(frame_rate > 0)) {
+        throw std::runtime_error("bad frame rate");
+    }
+    frame_cycles_ = MERLIN_INSTRUCTIONS_PER_SECOND / frame_rate + 0.5;
+    if (frame_cycles_ < 1) {
+        frame_cycles_ = 1;
+    }
+    reset(last_cycle_, r_);
+}
+
+void LedDisplay::reset(unsigned long long cycle, WORD r) {
+    frame_end_ = cycle + frame_cycles_;
+    last_cycle_ = cycle;
+    r_ = r & ((1 << R_WIDTH) - 1);
+    lit_ = r_;
+    ready_ = false;
+    for (int i = 0; i < R_WIDTH; i++) {
+        on_[i] = 0;
+        since_[i] = cycle;
+    }
+}
+
+/*
+ * Closes the frame ending at frame_end_: the lines still on are counted
+ * up to the end of the frame and carry over into the next one.
+ */
+void LedDisplay::close_frame() {
+    for (int i = 0; i < R_WIDTH; i++) {
+        unsigned long long on = on_[i];
+        if (r_ & (1 << i)) {
+            on += frame_end_ - since_[i];
+            since_[i] = frame_end_;
+        }
+        frame_.brightness[i] = (on * 255 + frame_cycles_ / 2) / frame_cycles_;
+        on_[i] = 0;
+    }
+    frame_.lit = lit_;
+    frame_.cycle = frame_end_;
+    frame_.number++;
+    lit_ = r_;
+    frame_end_ += frame_cycles_;
+    ready_ = true;
+}
+
+/*
+ * Brings the frames up to 'cycle'. Frames that pass without any R event
+ * just show the lines as they are, they're skipped in one go.
+ */
+void LedDisplay::advance(unsigned long long cycle) {
+    if (cycle < last_cycle_) {
+        reset(cycle, r_);
+        return;
+    }
+    if (cycle < frame_end_) {
+        return;
+    }
+    close_frame();
+    if (cycle >= frame_end_) {
+        unsigned long long frames = (cycle - frame_end_) / frame_cycles_ + 1;
+        frame_end_ += frames * frame_cycles_;
+        for (int i = 0; i < R_WIDTH; i++) {
+            frame_.brightness[i] = (r_ & (1 << i)) ? 255 : 0;
+            since_[i] = frame_end_ - frame_cycles_;
+        }
+        frame_.lit = r_;
+        frame_.cycle = frame_end_ - frame_cycles_;
+        frame_.number += frames;
+    }
+    last_cycle_ = cycle;
+}
+
+void LedDisplay::output(const OutputEvent *events, int count) {
+    for (int i = 0; i < count; i++) {
+        if (events[i].type == OUTPUT_R) {
+            output_r(events[i].cycle, events[i].index, events[i].value);
+        }
+    }
+}
+
+bool LedDisplay::get_frame(unsigned long long cycle, LedFrame &frame) {
+    advance(cycle);
+    if (!ready_) {
+        return false;
+    }
+    ready_ = false;
+    frame_.dirty = 0;
+    for (int i = 0; i < R_WIDTH; i++) {
+        if (frame_.brightness[i] != shown_[i]) {
+            frame_.dirty |= 1 << i;
+            shown_[i] = frame_.brightness[i];
+        }
+    }
+    frame = frame_;
+    return true;
+}
@@ -0,0 +1,91 @@
+/**
+ * @file display.h
+ * @author Carl Edwards
+ *
+ * Frame based LED display model for the TMS1100 C++ library.
+ *
+ * The game lights its LEDs through the R lines and blinks and multiplexes
+ * them far faster than a renderer wants to redraw. LedDisplay follows the
+ * R output, integrates how long each line is on in emulated cycles and
+ * closes a frame every 1/frame_rate of emulated time. A frame holds the
+ * brightness (duty cycle) of every line and the mask of lines that
+ * changed since the last frame the host took, so a renderer only does
+ * work for the LEDs that changed however many instructions ran.
+ *
+ * Feeding it an R event costs a few stores, frames are closed lazily when
+ * the next event or get_frame() comes past the end of a frame.
+ */
+#ifndef DISPLAY_H
+#define DISPLAY_H
+
+#include "tms1xx0.h"
+
+#define DISPLAY_FRAME_RATE 60
+
+struct LedFrame {
+    unsigned long number;           // frames closed since the display started
+    unsigned long long cycle;       // cycle the frame ended at
+    WORD lit;                       // R lines on for any part of the frame
+    WORD dirty;                     // lines whose brightness changed since the last get_frame()
+    BYTE brightness[R_WIDTH];       // share of the frame the line was on, 0-255
+};
+
+class LedDisplay {
+    private:
+    unsigned long long frame_cycles_;
+    unsigned long long frame_end_;
+    unsigned long long last_cycle_;
+    WORD r_;                        // lines on right now
+    WORD lit_;                      // lines on at some point in the current frame
+    unsigned long long on_[R_WIDTH];    // on-time in the current frame
+    unsigned long long since_[R_WIDTH]; // cycle a line that is on went on
+    LedFrame frame_;                // the last closed frame
+    bool ready_;                    // frame_ not taken by get_frame() yet
+    BYTE shown_[R_WIDTH];           // brightness the host has
+
+    void advance(unsigned long long cycle);
+    void close_frame();
+
+    public:
+    LedDisplay(double frame_rate = DISPLAY_FRAME_RATE);
+
+    // frames per second of emulated time, starts a new frame
+    void set_frame_rate(double frame_rate);
+
+    // start over at 'cycle' with the lines in 'r' on
+    void reset(unsigned long long cycle, WORD r);
+
+    // R output as TMS1100 reports it, at the cpu's current cycle
+    void output_r(unsigned long long cycle, int index, bool val);
+    void output(const OutputEvent *events, int count);
+
+    // the latest frame closed by 'cycle'. False if no frame has been
+    // closed since the last call, the host's picture is still current.
+    bool get_frame(unsigned long long cycle, LedFrame &frame);
+};
+
+/*
+ * Events come in cycle order, a cycle that goes backwards is a restored
+ * save state and starts the display over.
+ */
+inline void LedDisplay::output_r(unsigned long long cycle, int index, bool val) {
+    if (index < 0 || index >= R_WIDTH) {
+        return;
+    }
+    if (cycle >= frame_end_ || cycle < last_cycle_) {
+        advance(cycle);
+    }
+    last_cycle_ = cycle;
+    WORD bit = 1 << index;
+    if (val && !(r_ & bit)) {
+        r_ |= bit;
+        lit_ |= bit;
+        since_[index] = cycle;
+    }
+    else if (!val && (r_ & bit)) {
+        r_ &= ~bit;
+        on_[index] += cycle - since_[index];
+    }
+}
+
+#endif
@@ -0,0 +1,93 @@
+/**
+ * @file key_matrix.cpp
+ * @author Carl Edwards
+ *
+ * The Merlin keyboard matrix, see key_matrix.h.
+ */
+
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include "key_matrix.h"
+
+/*
+ * Where each key is wired: the O value that scans its row and its K bit.
+ *   O0:  K1(R0), K2(R1), K8(R2),  K4(R3)
+ *   O4:  K1(R4), K2(R5), K8(R6),  K4(R7)
+ *   O8:  K1(R8), K2(R9), K8(R10), K4(SG)
+ *   O12:         K2(CT), K8(NG),  K4(HM)
+ */
+static const struct {
+    BYTE o;
+    BYTE k;
+} key_wiring[MERLIN_KEY_COUNT] = {
+    {0, 1}, {0, 2}, {0, 8}, {0, 4},
+    {4, 1}, {4, 2}, {4, 8}, {4, 4},
+    {8, 1}, {8, 2}, {8, 8}, {8, 4},
+    {12, 2}, {12, 8}, {12, 4}
+};
+
+static void check_key(int key) {
+    if (key < 0 || key >= MERLIN_KEY_COUNT) {
+        throw std::runtime_error("bad key: " + std::to_string(key));
+    }
+}
+
+KeyMatrix::KeyMatrix(TMS1100 *cpu) {
+    cpu_ = cpu;
+    release_all();
+}
+
+/*
+ * Lets go of the keys whose time is up and rebuilds the K table from the
+ * keys still down.
+ */
+void KeyMatrix::update(unsigned long long cycle) {
+    memset(k_, 0, sizeof k_);
+    next_up_ = KEY_HELD_FOREVER;
+    for (int key = 0; key < MERLIN_KEY_COUNT; key++) {
+        if (up_[key] && up_[key] <= cycle) {
+            up_[key] = 0;
+        }
+        if (up_[key]) {
+            k_[key_wiring[key].o] |= key_wiring[key].k;
+            if (up_[key] < next_up_) {
+                next_up_ = up_[key];
+            }
+        }
+    }
+}
+
+void KeyMatrix::press(int key, unsigned long long hold_cycles) {
+    check_key(key);
+    unsigned long long cycle = cpu_->get_cycle();
+    up_[key] = hold_cycles < KEY_HELD_FOREVER - cycle ? cycle + hold_cycles : KEY_HELD_FOREVER;
+    update(cycle);
+}
+
+void KeyMatrix::key_down(int key) {
+    check_key(key);
+    up_[key] = KEY_HELD_FOREVER;
+    update(cpu_->get_cycle());
+}
+
+void KeyMatrix::key_up(int key) {
+    check_key(key);
+    up_[key] = 0;
+    update(cpu_->get_cycle());
+}
+
+void KeyMatrix::release_all() {
+    memset(up_, 0, sizeof up_);
+    memset(k_, 0, sizeof k_);
+    next_up_ = KEY_HELD_FOREVER;
+}
+
+bool KeyMatrix::is_down(int key) {
+    check_key(key);
+    return up_[key] > cpu_->get_cycle();
+}
+
+int KeyMatrix::input_k(void *ctx, int o_reg) {
+    return ((KeyMatrix *)ctx)->input_k(o_reg);
+}
@@ -0,0 +1,90 @@
+/**
+ * @file key_matrix.h
+ * @author Carl Edwards
+ *
+ * The Merlin keyboard matrix, native to the C++ library.
+ *
+ * The game scans the keys by putting a row on O (0, 4, 8 or 12) and
+ * reading K. KeyMatrix keeps a K value per O value up to date as keys go
+ * down and up, so answering a K read is a table lookup and never calls
+ * back into the host. Install it as the cpu's K input:
+ *
+ *   KeyMatrix keys(cpu);
+ *   cpu->set_input_k_cb(KeyMatrix::input_k, &keys);
+ *
+ * or call input_k() from the host's own K port.
+ *
+ * The game debounces the keys, a key has to stay down for a number of
+ * scans to register. press() holds a key down for a given number of
+ * cycles and lets it go by itself, so the host doesn't have to time it.
+ */
+#ifndef KEY_MATRIX_H
+#define KEY_MATRIX_H
+
+#include "tms1xx0.h"
+
+// long enough for the game to register a press, about 1/20s
+#define KEY_HOLD_CYCLES 3000
+
+// the release cycle of a key held until key_up()
+#define KEY_HELD_FOREVER 0xFFFFFFFFFFFFFFFFULL
+
+// the keys in scan order, MERLIN_KEY_0..MERLIN_KEY_10 are the grid keys
+// under LED 0..10 (the console shows key 0 as '~' and key 10 as '0')
+enum MerlinKey {
+    MERLIN_KEY_0,
+    MERLIN_KEY_1,
+    MERLIN_KEY_2,
+    MERLIN_KEY_3,
+    MERLIN_KEY_4,
+    MERLIN_KEY_5,
+    MERLIN_KEY_6,
+    MERLIN_KEY_7,
+    MERLIN_KEY_8,
+    MERLIN_KEY_9,
+    MERLIN_KEY_10,
+    MERLIN_KEY_SAME_GAME,
+    MERLIN_KEY_COMP_TURN,
+    MERLIN_KEY_NEW_GAME,
+    MERLIN_KEY_HIT_ME,
+    MERLIN_KEY_COUNT
+};
+
+class KeyMatrix {
+    private:
+    TMS1100 *cpu_;
+    BYTE k_[32];                                // K value per O value
+    unsigned long long up_[MERLIN_KEY_COUNT];   // cycle a key goes up, 0 when up
+    unsigned long long next_up_;                // earliest of up_[]
+
+    void update(unsigned long long cycle);
+
+    public:
+    // the cycle counter of 'cpu' times the presses
+    KeyMatrix(TMS1100 *cpu);
+
+    // key down for hold_cycles cycles from now
+    void press(int key, unsigned long long hold_cycles = KEY_HOLD_CYCLES);
+    // key down until key_up()
+    void key_down(int key);
+    void key_up(int key);
+    void release_all();
+    bool is_down(int key);
+
+    int input_k(int o_reg);
+    static int input_k(void *ctx, int o_reg);
+};
+
+/*
+ * Called for every K read, keys are only let go here so a read costs a
+ * compare and a lookup.
+ */
+inline int KeyMatrix::input_k(int o_reg) {
+    unsigned long long cycle = cpu_->get_cycle();
+    if (cycle >= next_up_) {
+        update(cycle);
+    }
+    return k_[o_reg & 0x1F];
+}
+
+#endif
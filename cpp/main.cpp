@@ -15,8 +15,12 @@
 #include <iomanip>
 #include <vector>
 #include <string>
-#include <unistd.h>
+#include <cstdlib>
+#include <thread>
+#include <chrono>
 #include "tms1xx0.h"
+#include "pacer.h"
+#include "output_ring.h"
 
 using namespace std;
 
@@ -28,27 +32,76 @@ void output_o_cb(int value) {
     //printf("output_o_cb: %d\n", value);
 }
 
-void run_emulator() {
+/*
+ * Drains the output ring on its own thread so printing never holds up
+ * the emulator.
+ */
+void display_thread(OutputRing *ring) {
+    OutputEvent events[256];
+    while (1) {
+        int count = ring->pop(events, 256);
+        for (int i = 0; i < count; i++) {
+            if (events[i].type == OUTPUT_R) {
+                output_r_cb(events[i].index, events[i].value);
+            }
+            else {
+                output_o_cb(events[i].value);
+            }
+        }
+        if (count == 0) {
+            this_thread::sleep_for(chrono::milliseconds(1));
+        }
+    }
+}
+
+void run_emulator(double speed, bool unthrottled) {
     ROM *rom = new ROM();
+#ifdef TMS1100_EMBEDDED_ROM
+    rom->load_embedded();
+#else
     rom->load_rom("mp3404.bin");
+#endif
+
+    OutputRing *ring = new OutputRing(4096);
+    thread(display_thread, ring).detach();
 
     TMS1100 emu = TMS1100(rom);
-    emu.set_output_r_cb(&output_r_cb);
-    emu.set_output_o_cb(&output_o_cb);
+    emu.set_output_ring(ring);
+    emu.set_output_change_only(true);
+
+    Pacer pacer = Pacer(&emu);
+    pacer.set_speed(speed);
+    pacer.set_unthrottled(unthrottled);
     while(1) {
-        emu.step();
-        usleep(75);
+        pacer.run_slice();
     }
 }
 
-int main()
+/*
+ * usage: merlin [-s speed] [-u]
+ *   -s  speed multiplier, 1.0 is the speed of the real hardware
+ *   -u  run unthrottled
+ */
+int main(int argc, char **argv)
 {
+    double speed = 1.0;
+    bool unthrottled = false;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "-s" && i + 1 < argc) {
+            speed = atof(argv[++i]);
+        }
+        else if (arg == "-u") {
+            unthrottled = true;
+        }
+    }
+
     cout << showbase // show the 0x prefix
         << internal // fill between the prefix and the number
         << setfill('0'); // fill with 0s
 
     try {
-        run_emulator();
+        run_emulator(speed, unthrottled);
     } catch(runtime_error &re) {
         cout << "unexpected error: " << re.what() << endl;
     }
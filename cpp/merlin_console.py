@@ -2,7 +2,8 @@
 """
 Python port of Milton Bradley's Merlin Electronic Game emulator.
 
-This python app calls into the C++ library (which then calls back into python).
+This python app calls into the C++ library, which only calls back into python for the
+sound. The keys and the LED display are modelled natively.
 
 This was inspired and ported from the work done by Dominic Thibodeau (hotkeysoft).
 https://github.com/hotkeysoft/emulators/tree/master/TMS1000
@@ -10,7 +11,8 @@ https://github.com/hotkeysoft/emulators/tree/master/TMS1000
 Thank you Dominic!!
 """
 
-from datetime import datetime
+import argparse
+import wave
 from blessed import Terminal
 import merlin
 
@@ -62,117 +64,150 @@ LED_POSITION = [
 
 LED_OFF_DEFAULT = ["~","1","2","3","4","5","6","7","8","9","0","","","",""]
 
-SOUND_ANIMATION_MICROS = 500 * 100
+# LEDs on for less of a display frame than this (out of 255) are drawn dim
+LED_BRIGHT = 128
+
+# keyboard character -> Merlin key
+KEY_MAP = {
+  u"~": merlin.KEY_0,
+  u"1": merlin.KEY_1,
+  u"2": merlin.KEY_2,
+  u"3": merlin.KEY_3,
+  u"4": merlin.KEY_4,
+  u"5": merlin.KEY_5,
+  u"6": merlin.KEY_6,
+  u"7": merlin.KEY_7,
+  u"8": merlin.KEY_8,
+  u"9": merlin.KEY_9,
+  u"0": merlin.KEY_10,
+  u"s": merlin.KEY_SAME_GAME,
+  u"c": merlin.KEY_COMP_TURN,
+  u"n": merlin.KEY_NEW_GAME,
+  u"h": merlin.KEY_HIT_ME,
+}
+
+# number of cpu steps executed per keyboard poll
+STEPS_PER_POLL = 64
+
+# while nobody presses a key, block on the keyboard for up to 20ms and then
+# run 20ms worth of steps (the real cpu does ~58333 steps/s)
+IDLE_POLL_SECONDS = 0.02
+IDLE_STEPS_PER_POLL = 1167
+
+# F2 saves the game to this file, F3 restores it
+STATE_FILENAME = "merlin.state"
+
+# the sound block stays on for 50ms of emulated time
+SOUND_ANIMATION_CYCLES = 58333 // 20
 SOUND_POSITION = (2,0)
 
 # pylint: disable = invalid-name
-g_input_key = None
-g_input_key_count = 0
 g_term = Terminal()
+g_emu = None
 g_sound_start = None
 
-def cpu_r_output_cb(y_value, on_off):
-  """ called by the CPU for handling hardware 'R' output """
-  led_pos = LED_POSITION[y_value]
-  led_char = g_term.red(u"■") if on_off else g_term.white(LED_OFF_DEFAULT[y_value])
-  print(g_term.move_yx(led_pos[0], led_pos[1]) + led_char)
+def draw_leds(frame):
+  """ redraws the LEDs whose brightness changed since the last display frame """
+  _, _, _, dirty, brightness = frame
+  for y_value, led_pos in enumerate(LED_POSITION):
+    if dirty >> y_value & 1:
+      if brightness[y_value] >= LED_BRIGHT:
+        led_char = g_term.red(u"■")
+      elif brightness[y_value]:
+        led_char = g_term.red(u"□")
+      else:
+        led_char = g_term.white(LED_OFF_DEFAULT[y_value])
+      print(g_term.move_yx(led_pos[0], led_pos[1]) + led_char)
 
 def cpu_o_output_cb(o_value):
   """ called by the CPU for handling hardware 'O' output """
   # pylint: disable = global-statement
   global g_sound_start
   if g_sound_start is not None:
-    diff = datetime.now() - g_sound_start
-    if diff.microseconds > SOUND_ANIMATION_MICROS:
+    # a restored state can move the clock backwards
+    diff = g_emu.cycle() - g_sound_start
+    if diff < 0 or diff > SOUND_ANIMATION_CYCLES:
       g_sound_start = None
       print(g_term.move_yx(SOUND_POSITION[0], SOUND_POSITION[1]) + g_term.white(SOUND_OFF))
   elif o_value & 0x01: # check for the sound bit
-    g_sound_start = datetime.now()
+    g_sound_start = g_emu.cycle()
     print(g_term.move_yx(SOUND_POSITION[0], SOUND_POSITION[1]) + g_term.white(SOUND_ON))
 
 
-def cpu_k_input_cb(o_reg):
-  """ called by the CPU for providing the hardware user input """
-  # pylint: disable = too-many-branches, global-statement
-  global g_input_key, g_input_key_count
-  inp = g_input_key
-  k_val = 0
-  if o_reg == 0:    # O0: K1(R0), K2(R1), K8(R2),  K4(R3)
-    if inp == u"~":
-      k_val = 1
-    elif inp == u"1":
-      k_val =  2
-    elif inp == u"2":
-      k_val =  8
-    elif inp == u"3":
-      k_val =  4
-  elif o_reg == 4:  # O1: K1(R4), K2(R5), K8(R6),  K4(R7)
-    if inp == u"4":
-      k_val =  1
-    elif inp == u"5":
-      k_val =  2
-    elif inp == u"6":
-      k_val =  8
-    elif inp == u"7":
-      k_val =  4
-  elif o_reg == 8:  # O2: K1(R8), K2(R9), K8(R10), K4(SG)
-    if inp == u"8":
-      k_val =  1
-    elif inp == u"9":
-      k_val =  2
-    elif inp == u"0":
-      k_val =  8
-    elif inp == u"s":
-      k_val =  4
-  elif o_reg == 12: # O3:         K2(CT), K8(NG),  K4(HM)
-    if inp == u"c":
-      k_val =  2
-    elif inp == u"n":
-      k_val =  8
-    elif inp == u"h":
-      k_val =  4
-
-  # hack to simulate a key being pressed down for 32 checks
-  if k_val > 0:
-    g_input_key_count = g_input_key_count - 1
-    if g_input_key_count <= 0:
-      g_input_key = None
-      g_input_key_count = 0
-
-  return k_val
-
 def main():
   """ the main entry point """
   # pylint: disable = global-statement
-  global g_input_key, g_input_key_count
+  global g_emu
+  parser = argparse.ArgumentParser(description="Merlin console emulator")
+  parser.add_argument("--record", metavar="TRACE", help="record the key presses to a trace file")
+  parser.add_argument("--replay", metavar="TRACE", help="replay a recorded trace, then continue live")
+  parser.add_argument("--wav", metavar="WAV", help="write the speaker sound to a WAV file")
+  args = parser.parse_args()
+
   print(g_term.clear)
   print(g_term.white(GAME_TEMPLATE))
 
-  merlin.init("mp3404.bin", cpu_r_output_cb, cpu_o_output_cb, cpu_k_input_cb)
+  # the LEDs are drawn from the display frames, not per R output, and the keys
+  # go to the native key matrix, K reads never call into python
+  emu = merlin.Merlin("mp3404.bin", None, cpu_o_output_cb)
+  g_emu = emu
+  wav = None
+  if args.wav:
+    wav = wave.open(args.wav, "wb")
+    wav.setnchannels(1)
+    wav.setsampwidth(2)
+    wav.setframerate(merlin.AUDIO_SAMPLE_RATE)
+    emu.start_audio(merlin.AUDIO_SAMPLE_RATE)
+  # when replaying the recording starts where the replay ends
+  if args.replay:
+    emu.start_replay(args.replay)
+  elif args.record:
+    emu.start_recording(args.record)
 
   with g_term.cbreak(), g_term.hidden_cursor():
     while True:
       # block w/ timeout waiting for a keyboard input
-      val = g_term.inkey(2 / 1000000)
+      idle = emu.idle()
+      val = g_term.inkey(IDLE_POLL_SECONDS if idle else 2 / 1000000)
       if not val:
         pass
       elif val.is_sequence:
-        pass
+        if val.name == u"KEY_F2":
+          emu.save_state_file(STATE_FILENAME)
+        elif val.name == u"KEY_F3" and not (args.record or args.replay):
+          # restoring would break the recorded/replayed timeline
+          try:
+            emu.load_state_file(STATE_FILENAME)
+          except RuntimeError:
+            pass
       elif val:
-        # keyboard inputs are a single-shot (i.e. we don't scan for key held down like
-        # hardware does (for switch debounce).
-        # To emulate the requirement for the Merlin hardware, we need the key to be held down
-        # for a total of 32 "reads" of the same value.
-        g_input_key = val.lower()
-        g_input_key_count = 32
-
+        # keyboard inputs are a single-shot (the terminal doesn't report key up), the
+        # key is held down long enough for the game's switch debounce to see it
+        key = val.lower()
         # quickly exit the emulator
-        if g_input_key == u"q":
+        if key == u"q":
           break
-
-      merlin.step()
-
-  merlin.deinit()
+        if key in KEY_MAP:
+          emu.press(KEY_MAP[key], merlin.KEY_HOLD_CYCLES)
+
+      if args.replay and emu.replay_finished():
+        emu.stop_replay()
+        args.replay = None
+        if args.record:
+          emu.start_recording(args.record)
+
+      emu.run(IDLE_STEPS_PER_POLL if idle else STEPS_PER_POLL)
+      frame = emu.led_frame()
+      if frame:
+        draw_leds(frame)
+      if wav:
+        wav.writeframes(emu.read_audio())
+
+  if args.record:
+    emu.stop_recording()
+  if wav:
+    wav.close()
+  emu.close()
 
 if __name__ == '__main__':
   main()
@@ -0,0 +1,145 @@
+/**
+ * @file mp3404_rom.h
+ * @author Carl Edwards
+ *
+ * mp3404.bin (the Merlin ROM) as a constant array, for builds with
+ * TMS1100_EMBEDDED_ROM. Generated from mp3404.bin (the bytes are what
+ * xxd -i prints), regenerate it if the image ever changes.
+ */
+#ifndef MP3404_ROM_H
+#define MP3404_ROM_H
+
+#define MP3404_ROM_SIZE 2048
+
+static constexpr BYTE mp3404_rom[MP3404_ROM_SIZE] = {
+    0x2c, 0x4f, 0x3e, 0x61, 0x80, 0x8a, 0x40, 0x7f, 0x93, 0x0b, 0x45, 0x27, 0x4f, 0x21, 0x87, 0x45,
+    0xa2, 0x4e, 0x0b, 0x27, 0x0b, 0x21, 0x06, 0x86, 0x3b, 0x2c, 0x03, 0x05, 0x07, 0x08, 0x2c, 0x27,
+    0xb9, 0x43, 0x3e, 0x37, 0x39, 0x86, 0x87, 0x60, 0x3b, 0x9a, 0x4f, 0x72, 0x25, 0x46, 0x43, 0x9f,
+    0x86, 0x4d, 0x62, 0x41, 0x04, 0x96, 0x06, 0xae, 0x8b, 0x32, 0x79, 0x7c, 0x4f, 0x9d, 0x0e, 0x0a,
+    0x4b, 0x68, 0x8e, 0x1e, 0xc0, 0x10, 0x78, 0xef, 0x13, 0x0b, 0xb3, 0xc0, 0x82, 0x85, 0x10, 0x48,
+    0x9d, 0xc0, 0x85, 0x80, 0xc0, 0x0b, 0x8e, 0x70, 0x20, 0x17, 0x85, 0x70, 0x1f, 0xcc, 0x0b, 0x0d,
+    0x00, 0x69, 0x17, 0x18, 0x70, 0xc0, 0x1f, 0xc3, 0x1e, 0xa4, 0x17, 0x72, 0x79, 0x70, 0x85, 0x9f,
+    0x28, 0x82, 0x0b, 0x12, 0x71, 0x85, 0x99, 0x55, 0x70, 0xc4, 0x70, 0xbf, 0x17, 0xb7, 0x5a, 0x05,
+    0x0b, 0x1a, 0x4d, 0xbd, 0x00, 0x23, 0x2f, 0x28, 0x00, 0x00, 0x00, 0x2f, 0x00, 0x4b, 0xde, 0x61,
+    0x00, 0x00, 0xb0, 0x00, 0x00, 0x00, 0x1e, 0x4b, 0x0b, 0x00, 0x47, 0x30, 0xb6, 0x2e, 0x40, 0x50,
+    0x00, 0xad, 0x00, 0x27, 0x00, 0x00, 0x00, 0x1e, 0x00, 0x13, 0x00, 0x29, 0xde, 0x2f, 0x38, 0x2c,
+    0x12, 0xc0, 0x00, 0xb5, 0x64, 0xde, 0x0b, 0xde, 0x1d, 0x1f, 0x1e, 0x10, 0x63, 0xde, 0x10, 0x87,
+    0x28, 0x7f, 0x20, 0x70, 0xc4, 0x7a, 0x97, 0x20, 0xb6, 0x1e, 0x14, 0x96, 0x4b, 0x48, 0x45, 0x3f,
+    0x00, 0x0b, 0x82, 0xef, 0x00, 0xa7, 0x10, 0x3f, 0x28, 0x60, 0x80, 0x97, 0x61, 0x3f, 0x87, 0xbe,
+    0x00, 0x60, 0x17, 0x55, 0x11, 0x2a, 0x2f, 0x28, 0x00, 0x11, 0x00, 0xa4, 0xcc, 0x1d, 0xb1, 0x79,
+    0x45, 0x05, 0x64, 0x62, 0x0b, 0x2d, 0x0b, 0xb6, 0xb4, 0x48, 0x96, 0x7e, 0x2d, 0x96, 0x38, 0xbb,
+    0x4b, 0x6a, 0xb3, 0x28, 0x27, 0x2a, 0xb8, 0x40, 0xb8, 0xc3, 0x3a, 0xc7, 0xee, 0x79, 0x70, 0x60,
+    0x00, 0x47, 0x25, 0x0b, 0x1c, 0x9f, 0x12, 0x4f, 0xb3, 0x2c, 0x27, 0x2a, 0x60, 0xb3, 0x17, 0x50,
+    0x00, 0x85, 0x07, 0x7a, 0x01, 0x1a, 0x17, 0xc0, 0x80, 0x3e, 0x0b, 0x82, 0x7c, 0x22, 0x24, 0x69,
+    0x71, 0xcc, 0x4b, 0x10, 0x47, 0x70, 0x47, 0x45, 0x10, 0xc4, 0x1f, 0x69, 0x0b, 0x40, 0x0f, 0x8f,
+    0x2c, 0x4b, 0x49, 0x6e, 0x13, 0x60, 0x82, 0x12, 0x22, 0xc0, 0xdf, 0x60, 0x2a, 0x1a, 0x20, 0x83,
+    0x00, 0x29, 0x2a, 0x17, 0x27, 0x16, 0x70, 0x10, 0x77, 0x47, 0xa9, 0x7c, 0x70, 0x2a, 0x60, 0x2a,
+    0x00, 0xdf, 0x27, 0x70, 0x47, 0x94, 0xc0, 0xdf, 0x97, 0x70, 0x80, 0x03, 0x03, 0x71, 0xc0, 0x4d,
+    0x8e, 0x1f, 0x07, 0xc7, 0x97, 0x2e, 0x97, 0x0f, 0x97, 0x12, 0x22, 0x27, 0x2e, 0x47, 0x21, 0x4f,
+    0x2a, 0x20, 0x2a, 0x21, 0x70, 0x47, 0xef, 0x29, 0xe4, 0x91, 0x49, 0x07, 0x27, 0x2a, 0x07, 0x00,
+    0xab, 0x10, 0xee, 0x0b, 0x82, 0x3e, 0x29, 0xa8, 0x2e, 0x80, 0x0b, 0x45, 0xc3, 0x8c, 0x45, 0xb3,
+    0x00, 0xb2, 0xc0, 0x1e, 0x17, 0x2a, 0x80, 0x2a, 0x27, 0x85, 0x27, 0x20, 0x22, 0x4f, 0x12, 0x2a,
+    0x07, 0xde, 0x27, 0x47, 0x00, 0xdf, 0x07, 0x27, 0x10, 0x27, 0x1a, 0x07, 0x3e, 0x2e, 0x20, 0x6f,
+    0x4b, 0x69, 0x27, 0x2e, 0x80, 0x47, 0x20, 0x4f, 0x2e, 0x78, 0xa1, 0x33, 0x7c, 0x28, 0x0f, 0x6a,
+    0x88, 0x0b, 0xd7, 0x80, 0x69, 0x28, 0x75, 0x28, 0x43, 0x80, 0x47, 0x3f, 0x0d, 0x10, 0x40, 0x2e,
+    0x00, 0x86, 0x06, 0x9d, 0x43, 0x27, 0x1f, 0xbc, 0x4d, 0x95, 0x20, 0x9d, 0x2e, 0x2e, 0x20, 0x28,
+    0x3f, 0x0f, 0x79, 0x50, 0x3b, 0x72, 0x9d, 0x0f, 0x61, 0x60, 0xcc, 0xbe, 0x0c, 0x5f, 0x60, 0x40,
+    0x28, 0x1f, 0x70, 0xc1, 0x10, 0x4d, 0xbc, 0x0b, 0xa2, 0xde, 0x3a, 0x27, 0x60, 0x1c, 0x78, 0x17,
+    0x19, 0xa6, 0x4f, 0xa9, 0x19, 0xbc, 0xbf, 0x19, 0xa1, 0x19, 0x48, 0xbc, 0x50, 0x8d, 0xbf, 0xc4,
+    0x9f, 0x2d, 0x27, 0x0b, 0x07, 0x0b, 0x45, 0x11, 0x80, 0x2d, 0x80, 0x70, 0x71, 0x68, 0xc9, 0x70,
+    0xbf, 0xbf, 0x9f, 0x82, 0x31, 0x80, 0x4f, 0xc0, 0xa3, 0x70, 0x70, 0x10, 0x1f, 0x60, 0x48, 0x2d,
+    0x10, 0xc0, 0x15, 0x0b, 0xb2, 0xf0, 0x0b, 0x15, 0x3e, 0x28, 0x0f, 0x8d, 0xb2, 0x0b, 0x21, 0xb4,
+    0x80, 0x27, 0x06, 0x20, 0xc4, 0x0b, 0x73, 0x15, 0x70, 0xa5, 0x4c, 0x3a, 0x8d, 0x41, 0x60, 0x2d,
+    0x00, 0xb8, 0x15, 0xc0, 0x24, 0x2d, 0x3f, 0x42, 0x1e, 0x41, 0x17, 0x21, 0x82, 0x0b, 0xc0, 0x60,
+    0x97, 0x15, 0x40, 0x36, 0x21, 0x45, 0x80, 0x6c, 0x0b, 0x37, 0x27, 0x68, 0x48, 0x68, 0x60, 0x44,
+    0x7f, 0x48, 0x39, 0x39, 0xb3, 0x97, 0x77, 0x9f, 0x23, 0x05, 0x19, 0x70, 0x7f, 0x9a, 0x0f, 0x70,
+    0x19, 0x3f, 0x28, 0x55, 0x32, 0xb5, 0x38, 0x41, 0x9d, 0xb3, 0x38, 0x38, 0x28, 0x2d, 0x96, 0x41,
+    0x92, 0x48, 0x89, 0x9d, 0x48, 0xaa, 0x91, 0x48, 0x0b, 0xb3, 0x48, 0x0f, 0xb3, 0x9d, 0x22, 0x77,
+    0x7f, 0x86, 0x73, 0x2d, 0x9d, 0x32, 0xb3, 0x9d, 0x3f, 0x9d, 0x48, 0xaf, 0x38, 0x3f, 0x28, 0x22,
+    0x2d, 0x4d, 0x12, 0x27, 0x1b, 0xad, 0x47, 0x2f, 0x9e, 0xf3, 0x00, 0x7d, 0x30, 0x3e, 0xa3, 0x47,
+    0x00, 0x0f, 0x87, 0x2f, 0x00, 0x00, 0x98, 0x13, 0x10, 0xa1, 0x2d, 0x27, 0x17, 0xbc, 0x40, 0x38,
+    0x00, 0x0b, 0x0b, 0x2f, 0x29, 0x00, 0x4b, 0x05, 0x00, 0x21, 0x00, 0x7c, 0x8b, 0x91, 0xc0, 0x2e,
+    0xde, 0xa1, 0x00, 0xba, 0x4d, 0x27, 0x75, 0x9e, 0xc0, 0xa7, 0x0f, 0x2a, 0x3f, 0xa4, 0x39, 0xaf,
+    0x3d, 0x2b, 0x8c, 0x40, 0x69, 0x68, 0x68, 0x70, 0x6a, 0x66, 0x6e, 0x62, 0x60, 0x6a, 0x70, 0xac,
+    0x0b, 0x60, 0x8c, 0x67, 0x10, 0x63, 0x8f, 0x6d, 0x6c, 0x6f, 0x6a, 0x62, 0x6a, 0xa5, 0xad, 0x70,
+    0x91, 0x64, 0xa9, 0xa9, 0x6f, 0x6c, 0x60, 0x84, 0xde, 0x68, 0xa6, 0x80, 0x68, 0x6a, 0xa9, 0x70,
+    0x6a, 0x6e, 0x0f, 0x70, 0x6c, 0x70, 0xa9, 0x86, 0x62, 0xa4, 0x0b, 0x70, 0x70, 0x9c, 0x70, 0x85,
+    0x27, 0x27, 0x87, 0x27, 0x04, 0x05, 0xaf, 0x27, 0x42, 0x04, 0x20, 0x07, 0x23, 0x27, 0x27, 0x42,
+    0x0a, 0x21, 0xbf, 0x04, 0x91, 0x7f, 0x05, 0xa4, 0x80, 0x7b, 0x27, 0x27, 0x0a, 0x0a, 0xa3, 0x21,
+    0x8d, 0x07, 0x04, 0x2f, 0x27, 0x76, 0x27, 0x3e, 0x41, 0x27, 0x0a, 0xb6, 0x07, 0x27, 0x7f, 0x77,
+    0x25, 0x96, 0xa8, 0x41, 0x27, 0x07, 0x27, 0x22, 0x0b, 0xaf, 0x40, 0x05, 0x04, 0x21, 0x48, 0x27,
+    0x46, 0x23, 0x07, 0x2b, 0xb0, 0xb7, 0x27, 0x0a, 0xb0, 0x42, 0x95, 0x7f, 0x0f, 0x70, 0x04, 0x05,
+    0x00, 0x70, 0xa3, 0x07, 0x00, 0xb3, 0x0a, 0x0a, 0x07, 0x27, 0x70, 0xba, 0x24, 0xb3, 0x21, 0x04,
+    0x00, 0x25, 0xb4, 0x0b, 0x70, 0x9b, 0x99, 0x8a, 0x00, 0x70, 0x00, 0x27, 0x40, 0x9e, 0x46, 0x44,
+    0xbe, 0x89, 0x0b, 0x77, 0xba, 0x3e, 0x70, 0x25, 0x3e, 0x22, 0x46, 0x27, 0x05, 0x27, 0x27, 0x46,
+    0x2f, 0x40, 0x28, 0x7f, 0x70, 0xc1, 0x82, 0x02, 0x70, 0x80, 0x1f, 0x69, 0x91, 0x7c, 0xcf, 0x60,
+    0xb8, 0x95, 0x80, 0x1c, 0x0b, 0xb8, 0x64, 0x0b, 0x69, 0x11, 0x80, 0xaa, 0xdb, 0x14, 0x29, 0x50,
+    0x00, 0xcf, 0x12, 0x72, 0x19, 0x80, 0x70, 0x2a, 0xf3, 0x70, 0x1b, 0x6f, 0x62, 0x70, 0x17, 0xcf,
+    0x6a, 0xc0, 0x70, 0xcf, 0x18, 0x6e, 0x1a, 0x2d, 0x10, 0x2e, 0x87, 0xcf, 0xcf, 0x2b, 0x0f, 0x8f,
+    0x60, 0x3e, 0xb8, 0x79, 0x33, 0x05, 0x04, 0x9d, 0x27, 0xa5, 0x4f, 0x5d, 0x90, 0xb1, 0xaf, 0x7a,
+    0x21, 0x86, 0x34, 0x46, 0x37, 0x36, 0x71, 0xa1, 0x28, 0x3e, 0xa2, 0x2c, 0x69, 0x27, 0xbd, 0x27,
+    0xa5, 0x3f, 0x4d, 0x88, 0x98, 0x0b, 0x3f, 0x0d, 0x0f, 0x70, 0x35, 0xa9, 0x30, 0x3a, 0x45, 0x04,
+    0x40, 0x38, 0x75, 0x87, 0xb9, 0x38, 0x4f, 0x0c, 0x45, 0x0b, 0x4f, 0xa7, 0x2c, 0x3b, 0x45, 0x28,
+    0x2c, 0x45, 0x28, 0x21, 0x97, 0xeb, 0x4e, 0x28, 0xeb, 0x05, 0x44, 0xeb, 0x13, 0xeb, 0x8a, 0x76,
+    0x98, 0xc9, 0xeb, 0x05, 0x9b, 0xab, 0xa8, 0x45, 0x0f, 0xb7, 0x42, 0xeb, 0x14, 0x70, 0x70, 0xb1,
+    0x00, 0x05, 0xeb, 0xab, 0xc9, 0xa4, 0x0f, 0x70, 0x60, 0x4c, 0xf5, 0x3f, 0x69, 0x97, 0x60, 0xa9,
+    0xeb, 0x4a, 0xf5, 0xb2, 0xab, 0x48, 0xeb, 0x70, 0x80, 0x70, 0xaa, 0x9a, 0x8c, 0x70, 0x86, 0x70,
+    0x28, 0x48, 0x17, 0x3f, 0x00, 0xe4, 0xb8, 0xbd, 0x00, 0x00, 0x00, 0x18, 0x00, 0x0f, 0x4f, 0x5a,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x64, 0x85, 0x10, 0x00, 0x00, 0x00, 0x23, 0x64, 0x85, 0xb7,
+    0x00, 0x0b, 0x00, 0x04, 0x00, 0x00, 0x00, 0x2c, 0x00, 0x00, 0x00, 0xfa, 0x0b, 0x00, 0x4f, 0x18,
+    0xff, 0xb8, 0x00, 0x83, 0x00, 0x10, 0x00, 0x0b, 0x77, 0x55, 0x7f, 0xbc, 0x05, 0x5a, 0x83, 0x46,
+    0x0b, 0x10, 0x22, 0xc0, 0x8c, 0x00, 0x20, 0x0b, 0x2a, 0xd7, 0x27, 0xb2, 0x27, 0x28, 0x0b, 0x1c,
+    0x88, 0x47, 0xc0, 0x12, 0xc0, 0xd7, 0x98, 0x28, 0x70, 0x80, 0x13, 0x0d, 0x60, 0x1c, 0x70, 0x70,
+    0x00, 0x47, 0x07, 0x0f, 0x0b, 0x3e, 0x80, 0x80, 0x0b, 0x17, 0x1b, 0x71, 0x80, 0x0b, 0x40, 0x14,
+    0x2a, 0x9c, 0x43, 0x78, 0xc0, 0x80, 0x61, 0x82, 0x50, 0x12, 0x70, 0x70, 0x80, 0x1f, 0x0b, 0x80,
+    0x0b, 0x10, 0x43, 0xde, 0x82, 0x60, 0x1b, 0x10, 0x0b, 0x14, 0x1a, 0x75, 0x1c, 0xf3, 0x0b, 0xde,
+    0x00, 0x1f, 0x70, 0x70, 0x7d, 0x79, 0xa7, 0x1c, 0xa1, 0x78, 0x10, 0x0b, 0x20, 0xc0, 0x20, 0xc3,
+    0x00, 0x2a, 0x70, 0x69, 0xad, 0x0b, 0x82, 0x10, 0x80, 0x0b, 0x80, 0x70, 0x7c, 0x0b, 0x8f, 0x9c,
+    0xa7, 0x28, 0x91, 0x0b, 0xc0, 0x12, 0xa7, 0x3f, 0x0d, 0xe4, 0x0b, 0x21, 0x17, 0x43, 0x2a, 0x0b,
+    0x2f, 0x4b, 0x05, 0x70, 0xc0, 0x22, 0xb4, 0x1d, 0x13, 0x12, 0xa1, 0x0c, 0xde, 0x45, 0x0b, 0x0b,
+    0x00, 0xc0, 0x23, 0xc3, 0x00, 0x00, 0x21, 0x47, 0x27, 0x0b, 0x80, 0x69, 0x27, 0x2a, 0xde, 0x38,
+    0x00, 0x22, 0x17, 0x5f, 0x0b, 0x2a, 0x10, 0xef, 0x00, 0x0d, 0x00, 0x4f, 0x47, 0x1c, 0x07, 0x10,
+    0x0f, 0x20, 0x47, 0x1e, 0x22, 0x60, 0xdd, 0xef, 0x70, 0xde, 0x43, 0x1e, 0x10, 0x0b, 0x80, 0x97,
+    0x0b, 0x1f, 0xb5, 0x70, 0x28, 0x49, 0x3e, 0x82, 0x20, 0xca, 0x24, 0x07, 0x22, 0xb6, 0x7a, 0x16,
+    0x00, 0x7f, 0x45, 0x2a, 0x0f, 0x50, 0x0d, 0xa9, 0x1a, 0x7f, 0x1a, 0x27, 0x07, 0xa1, 0x1e, 0x78,
+    0x00, 0x45, 0x7e, 0x4d, 0x06, 0x28, 0xae, 0x21, 0xb1, 0x21, 0x8a, 0x05, 0xc4, 0xf3, 0x45, 0x91,
+    0x9f, 0x2a, 0x71, 0x4d, 0xbc, 0x17, 0x1b, 0x0b, 0x8c, 0x2a, 0x22, 0x9e, 0xdb, 0x70, 0x0b, 0x91,
+    0x47, 0x3b, 0x1b, 0x82, 0x8a, 0xf3, 0x4f, 0x17, 0x0d, 0x1b, 0x17, 0x0b, 0x1b, 0x21, 0x1f, 0xe4,
+    0x0b, 0x61, 0x0f, 0xf3, 0xe4, 0x5d, 0x70, 0x2e, 0x78, 0xf3, 0x60, 0x28, 0x07, 0x70, 0xc0, 0x0b,
+    0xa5, 0xb7, 0x58, 0x2e, 0x20, 0xb7, 0x0b, 0x0b, 0x17, 0xad, 0x8c, 0x1e, 0xb7, 0x0c, 0x4f, 0x10,
+    0xa3, 0xb7, 0x0b, 0xb7, 0x50, 0x0b, 0x40, 0x0b, 0x27, 0x70, 0x82, 0x27, 0x0b, 0x3e, 0x4f, 0x2e,
+    0x45, 0x68, 0x2d, 0xa4, 0xd2, 0x45, 0xee, 0x3a, 0x90, 0x77, 0xa8, 0x64, 0x17, 0x90, 0x4d, 0xbc,
+    0xf3, 0x0b, 0x6c, 0xbf, 0x94, 0x17, 0xb0, 0x15, 0x30, 0xfb, 0x3a, 0x1b, 0x48, 0x22, 0xa8, 0x28,
+    0x94, 0x60, 0x15, 0x17, 0x0b, 0x39, 0x0b, 0x21, 0x1b, 0x45, 0xe4, 0x73, 0x04, 0x90, 0xb8, 0x15,
+    0x45, 0x9b, 0x94, 0x37, 0xa5, 0x61, 0xcb, 0xba, 0x39, 0x36, 0x28, 0x23, 0x48, 0xaf, 0x3f, 0x4a,
+    0x4a, 0x21, 0x68, 0x70, 0x91, 0x6f, 0x78, 0xae, 0x48, 0x19, 0xa5, 0x0b, 0x11, 0x27, 0x44, 0x46,
+    0x15, 0x11, 0x45, 0x70, 0xde, 0x0b, 0x6c, 0xaf, 0x68, 0x70, 0x8b, 0x42, 0x21, 0x3e, 0x06, 0x3e,
+    0x8a, 0x62, 0x73, 0xb4, 0x21, 0x0b, 0x95, 0x9e, 0x0b, 0x36, 0x10, 0xa1, 0x68, 0x46, 0x4c, 0x42,
+    0x8b, 0x86, 0x87, 0x0b, 0x48, 0x7b, 0x6c, 0x21, 0x7d, 0x4e, 0x25, 0x4a, 0x27, 0x8e, 0x73, 0x27,
+    0x48, 0x36, 0x27, 0x45, 0x19, 0x48, 0x10, 0x21, 0x1f, 0x78, 0x2d, 0x3b, 0x70, 0xde, 0x2d, 0x41,
+    0x1c, 0x70, 0x70, 0x80, 0x9a, 0x48, 0x48, 0x8e, 0x2d, 0x80, 0x9c, 0x0b, 0xab, 0x48, 0x38, 0x22,
+    0x80, 0x4d, 0x82, 0xde, 0x80, 0x80, 0x11, 0xab, 0x0b, 0x19, 0x11, 0x2d, 0x0f, 0x11, 0x33, 0xb3,
+    0x23, 0x10, 0x19, 0x38, 0x0b, 0x0f, 0x2d, 0x77, 0x0b, 0xab, 0x32, 0x98, 0x8e, 0xb7, 0x3f, 0x28,
+    0x29, 0x40, 0x29, 0x68, 0xa6, 0x47, 0x4f, 0x6c, 0x89, 0x11, 0x34, 0x3e, 0x64, 0x3e, 0x4f, 0x6e,
+    0x00, 0x42, 0x4d, 0xbc, 0x00, 0xbe, 0x22, 0x27, 0x3f, 0x62, 0xba, 0x27, 0xb1, 0x60, 0x77, 0x69,
+    0x00, 0xb4, 0x38, 0x27, 0x27, 0x61, 0x40, 0x35, 0x00, 0x2d, 0x00, 0x22, 0x28, 0x91, 0x7d, 0x29,
+    0x82, 0x7f, 0x66, 0x37, 0x23, 0x47, 0x7d, 0x0b, 0x86, 0x27, 0x29, 0xcc, 0x47, 0x10, 0x0b, 0x30,
+    0x6c, 0x61, 0x60, 0x6d, 0xa4, 0x4f, 0x70, 0xbe, 0x0b, 0x0b, 0x10, 0x21, 0x0b, 0x99, 0xef, 0x69,
+    0x00, 0x2f, 0x10, 0x1c, 0x00, 0xde, 0x97, 0x1b, 0xb9, 0x1b, 0xc0, 0x13, 0x20, 0xef, 0xac, 0x61,
+    0x00, 0x4f, 0x1b, 0xa5, 0xde, 0x0b, 0x91, 0xef, 0x00, 0xc0, 0x94, 0x18, 0x60, 0x0b, 0xe3, 0x3f,
+    0x2f, 0x7c, 0xb8, 0x42, 0x17, 0xef, 0x75, 0x44, 0x21, 0x0f, 0x41, 0x8c, 0x69, 0x0b, 0x60, 0x69,
+    0x2f, 0x4c, 0x60, 0x61, 0x13, 0xbd, 0x47, 0x6f, 0x3e, 0x8b, 0xb0, 0x2f, 0x27, 0x38, 0x61, 0x6a,
+    0x00, 0x93, 0x0f, 0x24, 0x00, 0x29, 0x4e, 0x4e, 0x82, 0x75, 0x2a, 0xa9, 0x80, 0x60, 0x60, 0x60,
+    0x00, 0x0f, 0x27, 0x2f, 0x4f, 0x13, 0x3e, 0x4c, 0x00, 0x2e, 0x0f, 0xbf, 0x3b, 0x95, 0x61, 0x60,
+    0x0b, 0xad, 0xb8, 0x2f, 0x0f, 0x64, 0x39, 0x61, 0x12, 0xbf, 0x6e, 0x4c, 0x68, 0x2f, 0x88, 0x0b,
+    0x2b, 0x40, 0x6e, 0x6f, 0x2b, 0x66, 0x6f, 0x66, 0x42, 0x4a, 0x1e, 0x60, 0xc4, 0xba, 0x0b, 0x69,
+    0x00, 0x64, 0x9e, 0x6a, 0x1e, 0xef, 0x6f, 0x8e, 0x8e, 0x1e, 0xba, 0x2b, 0x4a, 0x80, 0x40, 0x60,
+    0x00, 0x6f, 0x9b, 0x4a, 0x2b, 0xe4, 0xb0, 0x60, 0xb7, 0x6f, 0x0b, 0x6c, 0x60, 0x61, 0x2b, 0x63,
+    0x40, 0x9e, 0x9f, 0x64, 0x4a, 0x68, 0x4a, 0x4a, 0x65, 0x63, 0x40, 0x2b, 0x69, 0x8e, 0x6f, 0x05,
+    0x79, 0x27, 0x3b, 0x47, 0x70, 0xa4, 0x0b, 0x3b, 0x10, 0x95, 0xa4, 0x2c, 0x82, 0x3e, 0x17, 0xa4,
+    0x1e, 0xc0, 0x9d, 0x1f, 0x37, 0x2e, 0x1e, 0x49, 0x87, 0x0b, 0x1b, 0x9a, 0x10, 0xfb, 0x43, 0x0b,
+    0xa4, 0x47, 0x18, 0x49, 0x0b, 0x95, 0x70, 0x96, 0x0b, 0x1e, 0x47, 0xb7, 0x01, 0x9c, 0x63, 0x2e,
+    0x82, 0xde, 0x70, 0x00, 0xfd, 0x0b, 0x27, 0x0b, 0x0b, 0x4d, 0x1e, 0xde, 0x21, 0x10, 0xde, 0x10,
+};
+
+#endif
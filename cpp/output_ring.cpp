@@ -0,0 +1,48 @@
+/**
+ * @file output_ring.cpp
+ * @author Carl Edwards
+ *
+ * Lock-free single-producer/single-consumer ring of R/O output events.
+ */
+#include <string>
+#include "output_ring.h"
+
+OutputRing::OutputRing(unsigned long capacity, RingOverflow overflow) {
+    unsigned long size = 1;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    buffer_ = new OutputEvent[size];
+    mask_ = size - 1;
+    overflow_ = overflow;
+    head_ = 0;
+    tail_ = 0;
+    cached_tail_ = 0;
+    drops_ = 0;
+    high_water_ = 0;
+}
+
+OutputRing::~OutputRing() {
+    delete[] buffer_;
+}
+
+unsigned long OutputRing::capacity() {
+    return mask_ + 1;
+}
+
+unsigned long OutputRing::size() {
+    return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);
+}
+
+unsigned long OutputRing::get_drops() {
+    return drops_.load(std::memory_order_relaxed);
+}
+
+unsigned long OutputRing::get_high_water() {
+    return high_water_.load(std::memory_order_relaxed);
+}
+
+void OutputRing::reset_stats() {
+    drops_.store(0, std::memory_order_relaxed);
+    high_water_.store(0, std::memory_order_relaxed);
+}
@@ -0,0 +1,103 @@
+/**
+ * @file output_ring.h
+ * @author Carl Edwards
+ *
+ * Lock-free single-producer/single-consumer ring of R/O output events.
+ *
+ * The emulator thread pushes events as the cpu writes them and a separate
+ * display/audio thread drains them, so a slow front end never blocks the
+ * emulator (unless RING_BLOCK is asked for).
+ */
+#ifndef OUTPUT_RING_H
+#define OUTPUT_RING_H
+
+#include <atomic>
+#include <thread>
+#include "tms1xx0.h"
+
+// what push() does when the ring is full
+enum RingOverflow {
+    RING_DROP_NEWEST,   // drop the new event and count it
+    RING_BLOCK          // wait for the consumer to make room
+};
+
+class OutputRing {
+    private:
+    OutputEvent *buffer_;
+    unsigned long mask_;
+    RingOverflow overflow_;
+
+    // producer side
+    alignas(64) std::atomic<unsigned long> head_;
+    unsigned long cached_tail_;
+    std::atomic<unsigned long> drops_;
+    std::atomic<unsigned long> high_water_;
+
+    // consumer side
+    alignas(64) std::atomic<unsigned long> tail_;
+
+    public:
+    // capacity is rounded up to a power of 2
+    OutputRing(unsigned long capacity, RingOverflow overflow = RING_DROP_NEWEST);
+    ~OutputRing();
+
+    // producer
+    bool push(const OutputEvent &event);
+
+    // consumer, return the number of events read
+    bool pop(OutputEvent &event);
+    int pop(OutputEvent *events, int max_events);
+
+    unsigned long capacity();
+    unsigned long size();
+
+    // statistics, safe to read from either thread
+    unsigned long get_drops();
+    unsigned long get_high_water();
+    void reset_stats();
+};
+
+inline bool OutputRing::push(const OutputEvent &event) {
+    unsigned long head = head_.load(std::memory_order_relaxed);
+    if (head - cached_tail_ > mask_) {
+        cached_tail_ = tail_.load(std::memory_order_acquire);
+        while (head - cached_tail_ > mask_) {
+            if (overflow_ == RING_DROP_NEWEST) {
+                drops_.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            std::this_thread::yield();
+            cached_tail_ = tail_.load(std::memory_order_acquire);
+        }
+    }
+    buffer_[head & mask_] = event;
+    head_.store(head + 1, std::memory_order_release);
+
+    // cached_tail_ may be stale, only refresh it when the estimate says
+    // there could be a new high-water mark
+    unsigned long high_water = high_water_.load(std::memory_order_relaxed);
+    if (head + 1 - cached_tail_ > high_water) {
+        cached_tail_ = tail_.load(std::memory_order_acquire);
+        if (head + 1 - cached_tail_ > high_water) {
+            high_water_.store(head + 1 - cached_tail_, std::memory_order_relaxed);
+        }
+    }
+    return true;
+}
+
+inline int OutputRing::pop(OutputEvent *events, int max_events) {
+    unsigned long tail = tail_.load(std::memory_order_relaxed);
+    unsigned long available = head_.load(std::memory_order_acquire) - tail;
+    int count = available < (unsigned long)max_events ? (int)available : max_events;
+    for (int i = 0; i < count; i++) {
+        events[i] = buffer_[(tail + i) & mask_];
+    }
+    tail_.store(tail + count, std::memory_order_release);
+    return count;
+}
+
+inline bool OutputRing::pop(OutputEvent &event) {
+    return pop(&event, 1) == 1;
+}
+
+#endif
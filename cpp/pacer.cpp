@@ -0,0 +1,86 @@
+/**
+ * @file pacer.cpp
+ * @author Carl Edwards
+ *
+ * Real-time pacing for the TMS1100 C++ library.
+ */
+#include <string>
+#include <thread>
+#include "pacer.h"
+
+using namespace std;
+
+Pacer::Pacer(TMS1100 *cpu, double rate) {
+    cpu_ = cpu;
+    rate_ = rate;
+    speed_ = 1.0;
+    unthrottled_ = false;
+    slice_ = chrono::microseconds(PACER_SLICE_US);
+    idle_slice_ = chrono::microseconds(PACER_IDLE_SLICE_US);
+    reset();
+}
+
+void Pacer::set_speed(double speed) {
+    if (speed > 0) {
+        speed_ = speed;
+    }
+}
+
+double Pacer::get_speed() {
+    return speed_;
+}
+
+void Pacer::set_unthrottled(bool unthrottled) {
+    unthrottled_ = unthrottled;
+    reset();
+}
+
+bool Pacer::get_unthrottled() {
+    return unthrottled_;
+}
+
+void Pacer::set_slice_us(long slice_us) {
+    if (slice_us > 0) {
+        slice_ = chrono::microseconds(slice_us);
+    }
+}
+
+void Pacer::set_idle_slice_us(long slice_us) {
+    if (slice_us > 0) {
+        idle_slice_ = chrono::microseconds(slice_us);
+    }
+}
+
+void Pacer::reset() {
+    owed_ = 0;
+    started_ = false;
+}
+
+unsigned long Pacer::run_slice() {
+    chrono::microseconds slice = cpu_->get_idle() ? idle_slice_ : slice_;
+
+    // the fractional part is carried over so the long term rate is exact
+    owed_ += rate_ * speed_ * chrono::duration<double>(slice).count();
+    unsigned long count = (unsigned long)owed_;
+    owed_ -= count;
+
+    unsigned long executed = cpu_->run(count);
+    if (unthrottled_) {
+        return executed;
+    }
+
+    auto now = chrono::steady_clock::now();
+    if (!started_) {
+        deadline_ = now;
+        started_ = true;
+    }
+
+    // deadlines advance by exactly one slice so sleep jitter doesn't add up,
+    // but don't try to catch up after a long stall (debugger, suspend, ...)
+    deadline_ += slice;
+    if (now - deadline_ > chrono::microseconds(PACER_MAX_LAG_US)) {
+        deadline_ = now;
+    }
+    this_thread::sleep_until(deadline_);
+    return executed;
+}
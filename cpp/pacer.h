@@ -0,0 +1,68 @@
+/**
+ * @file pacer.h
+ * @author Carl Edwards
+ *
+ * Real-time pacing for the TMS1100 C++ library.
+ *
+ * Runs the cpu in time slices at the rate of the real hardware and sleeps
+ * once per slice against a monotonic deadline, instead of sleeping after
+ * every instruction. While nobody presses a key the slices get longer so
+ * an idle session wakes the host up less often.
+ */
+#ifndef PACER_H
+#define PACER_H
+
+#include <chrono>
+#include "tms1xx0.h"
+
+/*
+ * Merlin clocks its TMS1100 from an RC oscillator at about 350 kHz and an
+ * instruction takes 6 oscillator cycles.
+ */
+#define MERLIN_INSTRUCTIONS_PER_SECOND (350000 / 6)
+
+// default slice length
+#define PACER_SLICE_US 2000
+
+// default slice length while the cpu is idle, see TMS1100::get_idle()
+#define PACER_IDLE_SLICE_US 20000
+
+// if the host falls further behind than this the schedule is reset
+// rather than trying to catch up in one burst
+#define PACER_MAX_LAG_US 100000
+
+class Pacer {
+    private:
+    TMS1100 *cpu_;
+    double rate_;
+    double speed_;
+    bool unthrottled_;
+    std::chrono::microseconds slice_;
+    std::chrono::microseconds idle_slice_;
+    std::chrono::steady_clock::time_point deadline_;
+    double owed_;
+    bool started_;
+
+    public:
+    Pacer(TMS1100 *cpu, double rate = MERLIN_INSTRUCTIONS_PER_SECOND);
+
+    // speed multiplier, 1.0 is the real hardware rate
+    void set_speed(double speed);
+    double get_speed();
+
+    // run as fast as possible, never sleep
+    void set_unthrottled(bool unthrottled);
+    bool get_unthrottled();
+
+    void set_slice_us(long slice_us);
+    void set_idle_slice_us(long slice_us);
+
+    // run one slice worth of instructions, then sleep until the end of the
+    // slice. Returns the number of instructions executed.
+    unsigned long run_slice();
+
+    // forget the schedule, e.g. after the host has been paused
+    void reset();
+};
+
+#endif
@@ -1,93 +1,827 @@
 /**
  * @file python.cpp
  * @author Carl Edwards
- * 
+ *
  * Python bindings using pybind11 and the TMS1100 C++ library.
- * 
+ *
  * Compiling the Merlin library Mac:
- *   /usr/bin/clang++ -shared -std=c++2a -undefined dynamic_lookup 
- *     -g tms1xx0.cpp python.cpp `python3 -m pybind11 --includes` 
+ *   /usr/bin/clang++ -shared -std=c++2a -undefined dynamic_lookup
+ *     -g tms1xx0.cpp trace.cpp key_matrix.cpp display.cpp audio.cpp python.cpp `python3 -m pybind11 --includes`
  *     -o merlin`python3-config --extension-suffix`
+ *
+ * Add -DTMS1100_SWITCH_DISPATCH to build step() with the switch dispatcher,
+ * run() always runs the translated blocks.
  */
 
 #include "pybind11/functional.h"
 #include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+#include <cstring>
 #include "tms1xx0.h"
+#include "trace.h"
+#include "key_matrix.h"
+#include "display.h"
+#include "audio.h"
 
 namespace py = pybind11;
 
-/* 
- * Struct needed so we can deallocate the saved python callbacks.
- * If we don't, the python application "hangs" upon exit.
+typedef std::vector<std::tuple<unsigned long long, int, int, int>> OutputBatch;
+
+// output a GIL-free run() holds back before it pauses to deliver it
+#define DEFERRED_OUTPUT_MAX 65536
+
+class Merlin;
+
+/*
+ * The exporter behind the memoryviews of a session: a read-only buffer
+ * over live cpu memory. It holds a reference to the session, so the
+ * session and its cpu outlive every view of them.
  */
-struct Emulator {
-    TMS1100 *cpu_ = NULL;
+struct SessionView {
+    py::object session_ref;
+    Merlin *session;
+    const void *ptr;
+    py::ssize_t itemsize;
+    std::string format;
+    std::vector<py::ssize_t> shape;
+    std::vector<py::ssize_t> strides;
+
+    ~SessionView();
+};
+
+/*
+ * One Merlin session: its own cpu and python callbacks, the ROM image is
+ * shared with every other session on the same ROM. The session is the
+ * context pointer of its cpu callbacks.
+ */
+class Merlin {
+    private:
+    ROM *rom_;
+    TMS1100 *cpu_;
+    KeyMatrix *keys_;
+    LedDisplay display_;
+    Speaker *speaker_;
+    TraceRecorder *recorder_;
+    TracePlayer *player_;
     std::function<void(int, bool)> py_r_cb_;
     std::function<void(int)> py_o_cb_;
     std::function<int(int)> py_k_cb_;
+    std::function<void(OutputBatch)> py_batch_cb_;
+    std::function<void(bool)> py_idle_cb_;
+
+    // the cpu (or the replay) is running, callbacks made meanwhile may not
+    // change the session under it
+    bool busy_;
+    // the run has the GIL released: R/O output is held back
+    bool released_;
+    std::vector<OutputEvent> deferred_;
+    bool deferred_full_;        // the cpu was stopped to deliver deferred_
+    bool stop_requested_;       // stop() during the current run()
+
+    static void output_batch_cb(void *ctx, const OutputEvent *events, int count);
+    static void idle_cb(void *ctx, bool idle);
+    void defer(BYTE type, BYTE index, BYTE value);
+    void check_deferred();
+    void deliver_deferred();
+    void deliver(const OutputEvent *events, int count);
+    void restored();
+    unsigned long execute(unsigned long cycles, bool release_gil);
+
+    // cpu memory views, a closed session's cpu is kept until the last
+    // view is gone
+    int views_;
+    TMS1100 *closed_cpu_;
+    py::memoryview view(const void *ptr, py::ssize_t itemsize, std::string format,
+        std::vector<py::ssize_t> shape, std::vector<py::ssize_t> strides);
+
+    TMS1100 *cpu();
+    TMS1100 *stopped_cpu();
+
+    public:
+    Merlin(std::string rom_filename, std::function<void(int, bool)> r_cb,
+        std::function<void(int)> o_cb, std::function<int(int)> k_cb);
+    ~Merlin();
+
+    // I/O ports, see bind_io()
+    void output_r(int index, bool val);
+    void output_o(int val);
+    int input_k(int o_reg);
+
+    void step();
+    unsigned long run(unsigned long cycles, bool release_gil);
+    unsigned long run_until_cycle(unsigned long long cycle, bool release_gil);
+    unsigned long long cycle();
+    void stop();
+    void set_output_batch_cb(std::function<void(OutputBatch)> batch_cb);
+    void set_output_change_only(bool change_only);
+    bool idle();
+    unsigned long long idle_cycles();
+    void set_idle_cb(std::function<void(bool)> idle_cb);
+    py::bytes save_state();
+    void load_state(py::bytes data);
+    void save_state_file(std::string filename);
+    void load_state_file(std::string filename);
+    void start_recording(std::string filename);
+    void stop_recording();
+    void start_replay(std::string filename);
+    void stop_replay();
+    bool replay_finished();
+    unsigned long replay_mismatches();
+    void press(int key, unsigned long long hold_cycles);
+    void key_down(int key);
+    void key_up(int key);
+    void set_frame_rate(double frame_rate);
+    py::object led_frame();
+    void start_audio(int sample_rate);
+    void stop_audio();
+    py::object audio_block();
+    py::bytes read_audio();
+    unsigned long long audio_overruns();
+    py::memoryview registers();
+    py::memoryview r_latch();
+    py::memoryview ram();
+    void release_view();
+    void close();
 };
 
-Emulator *emu_ = NULL;
+void Merlin::output_r(int index, bool val) {
+    display_.output_r(cpu_->get_cycle(), index, val);
+    if (released_) {
+        defer(OUTPUT_R, index, val);
+    }
+    else if (py_r_cb_) {
+        py_r_cb_(index, val);
+    }
+}
+
+void Merlin::output_o(int val) {
+    if (speaker_) {
+        speaker_->output_o(cpu_->get_cycle(), val);
+    }
+    if (released_) {
+        defer(OUTPUT_O, 0, val);
+    }
+    else if (py_o_cb_) {
+        py_o_cb_(val);
+    }
+}
+
+/*
+ * K has to be answered right away, a released run() takes the GIL back
+ * for every read. Without k_cb the key matrix answers, no python involved.
+ */
+int Merlin::input_k(int o_reg) {
+    if (py_k_cb_) {
+        if (released_) {
+            py::gil_scoped_acquire acquire;
+            return py_k_cb_(o_reg);
+        }
+        return py_k_cb_(o_reg);
+    }
+    return keys_->input_k(o_reg);
+}
 
-void output_r_cb(int index, bool val) {
-    //printf("output_r_cb: %d value: %d\n", index, val);
-    if (emu_ && emu_->py_r_cb_) {
-        emu_->py_r_cb_(index, val);
+void Merlin::output_batch_cb(void *ctx, const OutputEvent *events, int count) {
+    Merlin *session = (Merlin *)ctx;
+    session->display_.output(events, count);
+    if (session->speaker_) {
+        session->speaker_->output(events, count);
+    }
+    if (session->released_) {
+        session->deferred_.insert(session->deferred_.end(), events, events + count);
+        session->check_deferred();
+    }
+    else {
+        session->deliver(events, count);
     }
 }
 
-void output_o_cb(int val) {
-    //printf("output_o_cb: %d\n", val);
-    if (emu_ && emu_->py_o_cb_) {
-        emu_->py_o_cb_(val);
+/*
+ * The cpu reports idle changes at the end of a run(), a released run()
+ * takes the GIL back for it like for k_cb.
+ */
+void Merlin::idle_cb(void *ctx, bool idle) {
+    Merlin *session = (Merlin *)ctx;
+    if (session->released_) {
+        py::gil_scoped_acquire acquire;
+        session->py_idle_cb_(idle);
+    }
+    else {
+        session->py_idle_cb_(idle);
     }
 }
 
-int input_k_cb(int o_reg) {
-    //printf("input_k_cb: %d\n", o_reg);
-    if (emu_ && emu_->py_k_cb_) {
-        return emu_->py_k_cb_(o_reg);
+void Merlin::defer(BYTE type, BYTE index, BYTE value) {
+    OutputEvent event;
+    event.cycle = cpu_->get_cycle();
+    event.type = type;
+    event.index = index;
+    event.value = value;
+    deferred_.push_back(event);
+    check_deferred();
+}
+
+/*
+ * A long run() would otherwise queue all of its output, once enough is
+ * held back the cpu stops and run() hands it over before going on.
+ */
+void Merlin::check_deferred() {
+    if (deferred_.size() >= DEFERRED_OUTPUT_MAX && !deferred_full_) {
+        deferred_full_ = true;
+        cpu_->stop();
+    }
+}
+
+void Merlin::deliver_deferred() {
+    std::vector<OutputEvent> events;
+    events.swap(deferred_);
+    if (!events.empty()) {
+        deliver(events.data(), events.size());
     }
-    return 0;
 }
 
-void init(std::string rom_filename, std::function<void(int, bool)> r_cb, std::function<void(int)> o_cb, std::function<int(int)> k_cb) {
-    if (emu_) {
+/*
+ * The cpu jumped to another state: the keys are let go and the display
+ * and sound start over from the restored R latch and O.
+ */
+void Merlin::restored() {
+    keys_->release_all();
+    display_.reset(cpu_->get_cycle(), *cpu_->get_r_latch());
+    if (speaker_) {
+        speaker_->reset(cpu_->get_cycle(), cpu_->get_registers()->o);
+    }
+}
+
+/*
+ * Hands output to python: as one list to the batch callback if there is
+ * one, otherwise event by event to the R/O callbacks.
+ */
+void Merlin::deliver(const OutputEvent *events, int count) {
+    if (py_batch_cb_) {
+        OutputBatch batch;
+        batch.reserve(count);
+        for (int i = 0; i < count; i++) {
+            batch.emplace_back(events[i].cycle, events[i].type, events[i].index, events[i].value);
+        }
+        py_batch_cb_(batch);
         return;
     }
-    emu_ = new Emulator;
-    emu_->py_r_cb_ = r_cb;
-    emu_->py_o_cb_ = o_cb;
-    emu_->py_k_cb_ = k_cb;
+    for (int i = 0; i < count; i++) {
+        if (events[i].type == OUTPUT_R) {
+            if (py_r_cb_) {
+                py_r_cb_(events[i].index, events[i].value);
+            }
+        }
+        else if (py_o_cb_) {
+            py_o_cb_(events[i].value);
+        }
+    }
+}
+
+Merlin::Merlin(std::string rom_filename, std::function<void(int, bool)> r_cb,
+        std::function<void(int)> o_cb, std::function<int(int)> k_cb) {
+    py_r_cb_ = r_cb;
+    py_o_cb_ = o_cb;
+    py_k_cb_ = k_cb;
 
-    ROM *rom = new ROM();
-    rom->load_rom(rom_filename);
-    emu_->cpu_ = new TMS1100(rom);
-    emu_->cpu_->set_output_r_cb(output_r_cb);
-    emu_->cpu_->set_output_o_cb(output_o_cb);
-    emu_->cpu_->set_input_k_cb(input_k_cb);
+    recorder_ = NULL;
+    player_ = NULL;
+    speaker_ = NULL;
+    views_ = 0;
+    closed_cpu_ = NULL;
+    busy_ = false;
+    released_ = false;
+    deferred_full_ = false;
+    stop_requested_ = false;
+    rom_ = ROM::load_shared(rom_filename);
+    cpu_ = new TMS1100(rom_);
+    keys_ = new KeyMatrix(cpu_);
+    cpu_->set_io(bind_io(this));
 }
 
-void step() {
-    if (emu_) {
-        emu_->cpu_->step();
+Merlin::~Merlin() {
+    close();
+    delete closed_cpu_;
+}
+
+TMS1100 *Merlin::cpu() {
+    if (!cpu_) {
+        throw std::runtime_error("Merlin session is closed");
     }
+    return cpu_;
 }
 
-void deinit() {
-    if (emu_) {
-        if (emu_->cpu_) {
-            delete emu_->cpu_;
+/*
+ * For everything that changes the session. While the cpu runs a callback
+ * (or, with the GIL released, another thread) would pull the cpu, replay
+ * or recording from under it, so that is an error.
+ */
+TMS1100 *Merlin::stopped_cpu() {
+    TMS1100 *cpu = this->cpu();
+    if (busy_) {
+        throw std::runtime_error("Merlin session is running");
+    }
+    return cpu;
+}
+
+void Merlin::step() {
+    TMS1100 *cpu = stopped_cpu();
+    busy_ = true;
+    try {
+        cpu->step();
+    } catch (...) {
+        busy_ = false;
+        throw;
+    }
+    busy_ = false;
+}
+
+/*
+ * Runs the cpu, or the replay when there is one, with the session busy.
+ * The flags are only changed while the GIL is held.
+ */
+unsigned long Merlin::execute(unsigned long cycles, bool release_gil) {
+    auto go = [&]() {
+        return player_ ? player_->run(cycles) : cpu_->run(cycles);
+    };
+    unsigned long count;
+    busy_ = true;
+    released_ = release_gil;
+    try {
+        if (release_gil) {
+            py::gil_scoped_release release;
+            count = go();
         }
-        delete emu_;
+        else {
+            count = go();
+        }
+    } catch (...) {
+        busy_ = false;
+        released_ = false;
+        throw;
     }
-    emu_ = NULL;
+    busy_ = false;
+    released_ = false;
+    return count;
+}
+
+/*
+ * With release_gil the cpu runs without the GIL so other python threads
+ * (and other sessions) keep going. Its R/O output is queued and handed
+ * to python in one go once the GIL is back. Nothing else may use this
+ * session until run() returns.
+ */
+unsigned long Merlin::run(unsigned long cycles, bool release_gil) {
+    stopped_cpu();
+    if (!release_gil) {
+        return execute(cycles, false);
+    }
+
+    unsigned long count = 0;
+    stop_requested_ = false;
+    do {
+        deferred_full_ = false;
+        try {
+            count += execute(cycles - count, true);
+        } catch (...) {
+            deferred_.clear();
+            throw;
+        }
+        deliver_deferred();
+        // only a stop for delivering the output goes on, and not if a
+        // callback has closed the session meanwhile
+    } while (deferred_full_ && !stop_requested_ && cpu_ && count < cycles);
+    return count;
+}
+
+unsigned long Merlin::run_until_cycle(unsigned long long cycle, bool release_gil) {
+    unsigned long long now = cpu()->get_cycle();
+    return cycle > now ? run(cycle - now, release_gil) : 0;
+}
+
+unsigned long long Merlin::cycle() {
+    return cpu()->get_cycle();
+}
+
+void Merlin::stop() {
+    stop_requested_ = true;
+    cpu()->stop();
+}
+
+void Merlin::set_output_batch_cb(std::function<void(OutputBatch)> batch_cb) {
+    // installing a new callback flushes whatever the old one still had
+    if (batch_cb) {
+        stopped_cpu()->set_output_batch_cb(output_batch_cb, this);
+    }
+    else {
+        stopped_cpu()->set_output_batch_cb(NULL);
+    }
+    py_batch_cb_ = batch_cb;
+}
+
+void Merlin::set_output_change_only(bool change_only) {
+    stopped_cpu()->set_output_change_only(change_only);
+}
+
+bool Merlin::idle() {
+    return cpu()->get_idle();
+}
+
+unsigned long long Merlin::idle_cycles() {
+    return cpu()->get_idle_cycles();
+}
+
+void Merlin::set_idle_cb(std::function<void(bool)> idle_cb) {
+    if (idle_cb) {
+        stopped_cpu()->set_idle_cb(Merlin::idle_cb, this);
+    }
+    else {
+        stopped_cpu()->set_idle_cb(NULL, NULL);
+    }
+    py_idle_cb_ = idle_cb;
+}
+
+/*
+ * Save states are handed to python in the on-disk format. They are only
+ * taken between runs, a snapshot of a running cpu would be torn.
+ */
+py::bytes Merlin::save_state() {
+    TMS1100 *cpu = stopped_cpu();
+    StateFile file;
+    memcpy(file.magic, STATE_MAGIC, sizeof file.magic);
+    file.version = STATE_VERSION;
+    file.size = sizeof(MachineState);
+    cpu->save_state(file.state);
+    return py::bytes((const char *)&file, sizeof file);
+}
+
+void Merlin::load_state(py::bytes data) {
+    std::string buffer(data);
+    StateFile file;
+    if (buffer.size() != sizeof file) {
+        throw std::runtime_error("bad save state size: " + std::to_string(buffer.size()));
+    }
+    memcpy(&file, buffer.data(), sizeof file);
+    check_state_file(file);
+    stopped_cpu()->load_state(file.state);
+    restored();
+}
+
+void Merlin::save_state_file(std::string filename) {
+    stopped_cpu()->save_state(filename);
+}
+
+void Merlin::load_state_file(std::string filename) {
+    stopped_cpu()->load_state(filename);
+    restored();
+}
+
+/*
+ * Recording logs the K input to a trace file, a replay feeds it back
+ * instead of calling k_cb. run() stops at the end of a replay.
+ */
+void Merlin::start_recording(std::string filename) {
+    if (recorder_ || player_) {
+        throw std::runtime_error("already recording or replaying");
+    }
+    recorder_ = new TraceRecorder(stopped_cpu(), bind_io(this), filename);
+}
+
+void Merlin::stop_recording() {
+    stopped_cpu();
+    if (recorder_) {
+        TraceRecorder *recorder = recorder_;
+        recorder_ = NULL;
+        try {
+            recorder->close();
+        } catch (...) {
+            delete recorder;
+            throw;
+        }
+        delete recorder;
+    }
+}
+
+void Merlin::start_replay(std::string filename) {
+    if (recorder_ || player_) {
+        throw std::runtime_error("already recording or replaying");
+    }
+    player_ = new TracePlayer(stopped_cpu(), bind_io(this), filename);
+    restored();
+}
+
+void Merlin::stop_replay() {
+    stopped_cpu();
+    delete player_;
+    player_ = NULL;
+}
+
+bool Merlin::replay_finished() {
+    return !player_ || player_->finished();
+}
+
+unsigned long Merlin::replay_mismatches() {
+    return player_ ? player_->get_mismatches() : 0;
+}
+
+/*
+ * The keys feed K when there is no k_cb. Hold times count cpu cycles,
+ * so a press lasts the same game time however fast run() is called.
+ */
+void Merlin::press(int key, unsigned long long hold_cycles) {
+    stopped_cpu();
+    keys_->press(key, hold_cycles);
+}
+
+void Merlin::key_down(int key) {
+    stopped_cpu();
+    keys_->key_down(key);
+}
+
+void Merlin::key_up(int key) {
+    stopped_cpu();
+    keys_->key_up(key);
+}
+
+void Merlin::set_frame_rate(double frame_rate) {
+    stopped_cpu();
+    display_.set_frame_rate(frame_rate);
+}
+
+/*
+ * The display frame as of now, None when no frame has ended since the
+ * last call. Batched output is flushed first so the display has seen it.
+ */
+py::object Merlin::led_frame() {
+    TMS1100 *cpu = stopped_cpu();
+    LedFrame frame;
+    cpu->flush_output();
+    if (!display_.get_frame(cpu->get_cycle(), frame)) {
+        return py::none();
+    }
+    return py::make_tuple(frame.number, frame.cycle, frame.lit, frame.dirty,
+        py::bytes((const char *)frame.brightness, sizeof frame.brightness));
+}
+
+/*
+ * Sound is made only while asked for, samples are buffered until python
+ * pulls them. The buffer is AUDIO_RING_SAMPLES long, beyond that the
+ * oldest samples are dropped.
+ */
+void Merlin::start_audio(int sample_rate) {
+    TMS1100 *cpu = stopped_cpu();
+    Speaker *speaker = new Speaker(sample_rate);
+    cpu->flush_output();
+    speaker->reset(cpu->get_cycle(), cpu->get_registers()->o);
+    delete speaker_;
+    speaker_ = speaker;
+}
+
+void Merlin::stop_audio() {
+    stopped_cpu();
+    delete speaker_;
+    speaker_ = NULL;
+}
+
+/*
+ * One AUDIO_BLOCK_SAMPLES block of 16 bit samples up to now, None until
+ * a whole block has been made.
+ */
+py::object Merlin::audio_block() {
+    TMS1100 *cpu = stopped_cpu();
+    if (!speaker_) {
+        throw std::runtime_error("audio not started");
+    }
+    short block[AUDIO_BLOCK_SAMPLES];
+    cpu->flush_output();
+    speaker_->advance(cpu->get_cycle());
+    if (!speaker_->read_block(block)) {
+        return py::none();
+    }
+    return py::bytes((const char *)block, sizeof block);
+}
+
+py::bytes Merlin::read_audio() {
+    TMS1100 *cpu = stopped_cpu();
+    if (!speaker_) {
+        throw std::runtime_error("audio not started");
+    }
+    cpu->flush_output();
+    speaker_->advance(cpu->get_cycle());
+    std::vector<short> samples(speaker_->available());
+    speaker_->read(samples.data(), samples.size());
+    return py::bytes((const char *)samples.data(), samples.size() * sizeof(short));
+}
+
+unsigned long long Merlin::audio_overruns() {
+    return speaker_ ? speaker_->get_overruns() : 0;
+}
+
+/*
+ * Read-only views of the live cpu memory, nothing is copied. A view keeps
+ * the session alive, and after close() it shows the state the session
+ * was closed in. Nothing stops another thread reading a view while a
+ * GIL-free run() changes the memory under it, what it sees then is torn.
+ */
+py::memoryview Merlin::view(const void *ptr, py::ssize_t itemsize, std::string format,
+        std::vector<py::ssize_t> shape, std::vector<py::ssize_t> strides) {
+    SessionView *view = new SessionView();
+    view->session_ref = py::cast(this, py::return_value_policy::reference);
+    view->session = this;
+    view->ptr = ptr;
+    view->itemsize = itemsize;
+    view->format = format;
+    view->shape = shape;
+    view->strides = strides;
+    // from here on the view's destructor gives the count back
+    views_++;
+    return py::memoryview(py::cast(view, py::return_value_policy::take_ownership));
+}
+
+SessionView::~SessionView() {
+    session->release_view();
+}
+
+void Merlin::release_view() {
+    views_--;
+    if (views_ == 0 && closed_cpu_) {
+        delete closed_cpu_;
+        closed_cpu_ = NULL;
+    }
+}
+
+py::memoryview Merlin::registers() {
+    return view(cpu()->get_registers(), 1, py::format_descriptor<BYTE>::format(),
+        {(py::ssize_t)sizeof(Registers)}, {1});
+}
+
+py::memoryview Merlin::r_latch() {
+    return view(cpu()->get_r_latch(), sizeof(WORD), py::format_descriptor<WORD>::format(),
+        {1}, {(py::ssize_t)sizeof(WORD)});
+}
+
+py::memoryview Merlin::ram() {
+    return view(cpu()->get_ram_data(), 1, py::format_descriptor<BYTE>::format(),
+        {RAM_SIZE / 16, 8}, {8, 1});
+}
+
+/*
+ * Drops the cpu and the saved python callbacks. If the callbacks are kept
+ * alive the python application "hangs" upon exit.
+ */
+void Merlin::close() {
+    if (busy_) {
+        throw std::runtime_error("Merlin session is running");
+    }
+    delete recorder_;
+    delete player_;
+    recorder_ = NULL;
+    player_ = NULL;
+    delete speaker_;
+    speaker_ = NULL;
+    if (cpu_) {
+        delete keys_;
+        if (views_ > 0) {
+            // the cpu isn't run again, only read through the views
+            closed_cpu_ = cpu_;
+        }
+        else {
+            delete cpu_;
+        }
+        rom_->release();
+        cpu_ = NULL;
+        keys_ = NULL;
+        rom_ = NULL;
+    }
+    py_r_cb_ = nullptr;
+    py_o_cb_ = nullptr;
+    py_k_cb_ = nullptr;
+    py_batch_cb_ = nullptr;
+    py_idle_cb_ = nullptr;
 }
 
 PYBIND11_MODULE(merlin, m) {
     m.doc() = "Merlin TMS1100 emulator";
 
-    m.def("init", &init, "initialize the Merlin emulator");
-    m.def("step", &step, "perform one step of the TMS1100 cpu");
-    m.def("deinit", &deinit, "deinitialize the Merlin emulator");
+    py::class_<Merlin>(m, "Merlin", "a Merlin emulator session, sessions are independent of each other")
+        .def(py::init<std::string, std::function<void(int, bool)>, std::function<void(int)>,
+            std::function<int(int)>>(), "load the ROM and create the emulator",
+            py::arg("rom_filename"), py::arg("r_cb"), py::arg("o_cb"), py::arg("k_cb") = py::none())
+        .def("step", &Merlin::step, "perform one step of the TMS1100 cpu")
+        .def("run", &Merlin::run,
+            "perform up to n steps of the TMS1100 cpu, returns the number of steps executed. "
+            "With release_gil=True other python threads run meanwhile: R/O output is queued "
+            "and delivered when the steps are done (or every DEFERRED_OUTPUT_MAX events), k_cb still runs (taking the GIL) as K is read. "
+            "Until it returns, anything that changes the session (from a callback too) raises RuntimeError. "
+            "Without k_cb K comes from the key matrix and python isn't called at all",
+            py::arg("n"), py::arg("release_gil") = false)
+        .def("run_until_cycle", &Merlin::run_until_cycle,
+            "same as run() up to the point cycle() reaches 'cycle'",
+            py::arg("cycle"), py::arg("release_gil") = false)
+        .def("cycle", &Merlin::cycle,
+            "the emulated time: instructions executed since reset, one instruction is one cycle. "
+            "In a callback, the cycle of the instruction that caused it. From another thread during "
+            "run(release_gil=True) it is read unsynchronized and only approximate")
+        .def("stop", &Merlin::stop,
+            "end the current run() early, from a callback or, during run(release_gil=True), another thread")
+        .def("set_output_batch_cb", &Merlin::set_output_batch_cb,
+            "buffer R/O output and deliver it once per run() as a list of (cycle, type, index, value), "
+            "type is OUTPUT_R or OUTPUT_O. Pass None to go back to the R/O callbacks")
+        .def("set_output_change_only", &Merlin::set_output_change_only,
+            "only report R lines and O values that actually changed")
+        .def("idle", &Merlin::idle,
+            "True when no key has been pressed for about a second (as of the last run(), "
+            "unsynchronized during another thread's run(release_gil=True)). Idle only tells the "
+            "host it may poll less often: the game keeps blinking and scanning, so run() still "
+            "executes every cycle and never blocks waiting for a key")
+        .def("idle_cycles", &Merlin::idle_cycles,
+            "number of cycles executed while idle, none are skipped (as of the last run(), "
+            "unsynchronized during another thread's run(release_gil=True))")
+        .def("set_idle_cb", &Merlin::set_idle_cb,
+            "call idle_cb(idle) at the end of the run() in which idle() changes, so a host can "
+            "slow its polling (or sleep on its own input) without asking every time. None turns it off",
+            py::arg("idle_cb"))
+        .def("save_state", &Merlin::save_state,
+            "snapshot the cpu and RAM, returns bytes. Raises RuntimeError while the session runs")
+        .def("load_state", &Merlin::load_state,
+            "restore a save_state() snapshot, the restored R lines and O are reported to the callbacks",
+            py::arg("data"))
+        .def("save_state_file", &Merlin::save_state_file,
+            "write a snapshot to a file. Raises RuntimeError while the session runs", py::arg("filename"))
+        .def("load_state_file", &Merlin::load_state_file, "restore a snapshot from a file", py::arg("filename"))
+        .def("start_recording", &Merlin::start_recording,
+            "log the K input from now on to a trace file", py::arg("filename"))
+        .def("stop_recording", &Merlin::stop_recording, "finish the trace file")
+        .def("start_replay", &Merlin::start_replay,
+            "restore the state a trace started from and replay its K input instead of calling k_cb",
+            py::arg("filename"))
+        .def("stop_replay", &Merlin::stop_replay, "go back to live K input")
+        .def("replay_finished", &Merlin::replay_finished, "True once run() has reached the end of the trace")
+        .def("replay_mismatches", &Merlin::replay_mismatches,
+            "number of K reads that didn't match the trace, 0 for a faithful replay")
+        .def("press", &Merlin::press,
+            "hold a KEY_* down for hold_cycles cpu cycles, used when there is no k_cb",
+            py::arg("key"), py::arg("hold_cycles") = (unsigned long long)KEY_HOLD_CYCLES)
+        .def("key_down", &Merlin::key_down, "hold a KEY_* down until key_up()", py::arg("key"))
+        .def("key_up", &Merlin::key_up, "let go of a KEY_*", py::arg("key"))
+        .def("set_frame_rate", &Merlin::set_frame_rate,
+            "LED display frames per second of emulated time", py::arg("frame_rate"))
+        .def("led_frame", &Merlin::led_frame,
+            "the latest LED display frame as (number, cycle, lit, dirty, brightness) or None if "
+            "no frame has ended since the last call. lit and dirty are masks of R lines, dirty "
+            "has the lines whose brightness changed since the last frame returned, brightness "
+            "has the share of the frame each R line was on, 0-255")
+        .def("start_audio", &Merlin::start_audio,
+            "render the speaker to 16 bit mono PCM from now on, at emulated speed",
+            py::arg("sample_rate") = AUDIO_SAMPLE_RATE)
+        .def("stop_audio", &Merlin::stop_audio, "stop rendering and drop the samples not read yet")
+        .def("audio_block", &Merlin::audio_block,
+            "the next AUDIO_BLOCK_SAMPLES samples as bytes (native int16), None until run() has "
+            "made a whole block")
+        .def("read_audio", &Merlin::read_audio,
+            "the samples made so far as bytes (native int16). At most AUDIO_RING_SAMPLES are kept, "
+            "read at least that often or the oldest are dropped")
+        .def("audio_overruns", &Merlin::audio_overruns,
+            "number of samples dropped since start_audio() because they weren't read in time")
+        .def("registers", &Merlin::registers,
+            "read-only live view of the registers, one byte each in REGISTER_NAMES order. "
+            "Reading a view from another thread during run(release_gil=True) gives a torn "
+            "picture, copy it between runs (or use save_state()) for a consistent one")
+        .def("r_latch", &Merlin::r_latch,
+            "read-only live view of the R latch, one uint16 with bit n for R line n")
+        .def("ram", &Merlin::ram,
+            "read-only live view of the RAM, 8 rows (X) of 8 bytes. Word Y is in the low nibble "
+            "of byte Y // 2 for even Y and in the high nibble for odd Y")
+        .def("close", &Merlin::close,
+            "release the emulator and the saved callbacks. Views taken before stay readable "
+            "and show the state the session was closed in");
+
+    py::class_<SessionView>(m, "SessionView", py::buffer_protocol(),
+            "read-only buffer over a session's memory, see Merlin.registers()/r_latch()/ram()")
+        .def_buffer([](SessionView &view) -> py::buffer_info {
+            return py::buffer_info(const_cast<void *>(view.ptr), view.itemsize, view.format,
+                view.shape.size(), view.shape, view.strides, true);
+        });
+
+    m.def("set_rom_cache_dir", &ROM::set_cache_dir,
+        "keep remapped ROM images in this directory so later sessions skip the remap, '' turns it off",
+        py::arg("dir"));
+
+    m.attr("REGISTER_NAMES") = py::make_tuple("a", "cl", "ca", "cb", "cs", "k", "o", "pa", "pb",
+        "pc", "s", "sl", "sr", "x", "y");
+    for (int key = MERLIN_KEY_0; key <= MERLIN_KEY_10; key++) {
+        m.attr(("KEY_" + std::to_string(key)).c_str()) = key;
+    }
+    m.attr("KEY_SAME_GAME") = (int)MERLIN_KEY_SAME_GAME;
+    m.attr("KEY_COMP_TURN") = (int)MERLIN_KEY_COMP_TURN;
+    m.attr("KEY_NEW_GAME") = (int)MERLIN_KEY_NEW_GAME;
+    m.attr("KEY_HIT_ME") = (int)MERLIN_KEY_HIT_ME;
+    m.attr("KEY_HOLD_CYCLES") = KEY_HOLD_CYCLES;
+    m.attr("DISPLAY_FRAME_RATE") = DISPLAY_FRAME_RATE;
+    m.attr("AUDIO_SAMPLE_RATE") = AUDIO_SAMPLE_RATE;
+    m.attr("AUDIO_BLOCK_SAMPLES") = AUDIO_BLOCK_SAMPLES;
+    m.attr("AUDIO_RING_SAMPLES") = AUDIO_RING_SAMPLES;
+    m.attr("DEFERRED_OUTPUT_MAX") = DEFERRED_OUTPUT_MAX;
+    m.attr("OUTPUT_R") = (int)OUTPUT_R;
+    m.attr("OUTPUT_O") = (int)OUTPUT_O;
 }
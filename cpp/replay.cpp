@@ -0,0 +1,173 @@
+/**
+ * @file replay.cpp
+ * @author Carl Edwards
+ *
+ * Replays K input traces recorded with TraceRecorder, unthrottled.
+ *
+ * For every trace the R/O output of the replay is hashed, so the same
+ * trace replayed against a changed emulator can be compared in bulk. A
+ * trace that doesn't replay faithfully (K reads no longer line up with
+ * the recording) is reported and makes the exit status 1.
+ *
+ * With -w the speaker sound of every replay is written next to its trace
+ * as <trace>.wav, an offline render at the emulated (not wall clock) rate.
+ *
+ * Compiling:
+ *   /usr/bin/clang++ -std=c++2a -O2 tms1xx0.cpp trace.cpp audio.cpp replay.cpp -o merlin_replay
+ *
+ * Usage:
+ *   merlin_replay [-r rom] [-w] trace...
+ *     -r  ROM image (default mp3404.bin)
+ *     -w  write the sound of each replay to <trace>.wav
+ */
+#include <iostream>
+#include <string>
+#include <chrono>
+#include "tms1xx0.h"
+#include "trace.h"
+#include "audio.h"
+
+using namespace std;
+
+/*
+ * FNV-1a over the (cycle, type, index, value) of every output.
+ */
+class HashHost {
+    public:
+    TMS1100 *cpu;
+    Speaker *speaker;
+    unsigned long long hash;
+    unsigned long outputs;
+
+    HashHost(TMS1100 *cpu_) {
+        cpu = cpu_;
+        speaker = NULL;
+        hash = 14695981039346656037ULL;
+        outputs = 0;
+    }
+
+    void mix(unsigned long long value) {
+        for (int i = 0; i < 8; i++) {
+            hash = (hash ^ ((value >> (i * 8)) & 0xFF)) * 1099511628211ULL;
+        }
+    }
+
+    void output_r(int index, bool val) {
+        mix(cpu->get_cycle());
+        mix((OUTPUT_R << 16) | (index << 8) | val);
+        outputs++;
+    }
+
+    void output_o(int val) {
+        mix(cpu->get_cycle());
+        mix((OUTPUT_O << 16) | val);
+        outputs++;
+        if (speaker) {
+            speaker->output_o(cpu->get_cycle(), val);
+        }
+    }
+
+    int input_k(int) {
+        return 0;
+    }
+};
+
+/*
+ * Same as TracePlayer::run_to_end() with the speaker rendered and
+ * written out between slices. A slice makes ~8k samples, well within
+ * what the speaker buffers.
+ */
+#define WAV_SLICE_CYCLES 10000
+
+unsigned long replay_to_wav(TMS1100 *emu, TracePlayer *player, HashHost *host, string filename) {
+    Speaker speaker;
+    speaker.reset(emu->get_cycle(), emu->get_registers()->o);
+    WavWriter writer(filename, speaker.get_sample_rate());
+    host->speaker = &speaker;
+
+    short block[AUDIO_BLOCK_SAMPLES];
+    unsigned long count = 0;
+    while (!player->finished()) {
+        unsigned long executed = player->run(WAV_SLICE_CYCLES);
+        if (executed == 0) {
+            break;
+        }
+        count += executed;
+        speaker.advance(emu->get_cycle());
+        unsigned long samples;
+        while ((samples = speaker.read(block, AUDIO_BLOCK_SAMPLES)) > 0) {
+            writer.write(block, samples);
+        }
+    }
+    host->speaker = NULL;
+    writer.close();
+    return count;
+}
+
+int main(int argc, char **argv) {
+    string rom_filename = "mp3404.bin";
+    bool wav = false;
+    int first = 1;
+    while (first < argc) {
+        string arg = argv[first];
+        if (arg == "-r" && first + 1 < argc) {
+            rom_filename = argv[first + 1];
+            first += 2;
+        }
+        else if (arg == "-w") {
+            wav = true;
+            first++;
+        }
+        else {
+            break;
+        }
+    }
+    if (first >= argc) {
+        cout << "usage: " << argv[0] << " [-r rom] [-w] trace..." << endl;
+        return 1;
+    }
+
+    int failed = 0;
+    try {
+        ROM *rom = new ROM();
+        rom->load_rom(rom_filename);
+
+        for (int i = first; i < argc; i++) {
+            TMS1100 emu = TMS1100(rom);
+            HashHost host = HashHost(&emu);
+            try {
+                TracePlayer player = TracePlayer(&emu, bind_io(&host), argv[i]);
+                // the display report from restoring the start state isn't
+                // part of the replay
+                host.hash = HashHost(&emu).hash;
+                host.outputs = 0;
+                auto start = chrono::steady_clock::now();
+                unsigned long cycles;
+                if (wav) {
+                    cycles = replay_to_wav(&emu, &player, &host, string(argv[i]) + ".wav");
+                }
+                else {
+                    cycles = player.run_to_end();
+                }
+                chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+                unsigned long mismatches = player.get_mismatches();
+                printf("%s: %lu cycles, %lu K changes, %lu outputs, hash %016llx, %.3f s%s\n",
+                    argv[i], cycles, player.get_records(), host.outputs, host.hash,
+                    elapsed.count(), mismatches ? "" : ", ok");
+                if (mismatches) {
+                    printf("%s: DIVERGED, %lu K reads don't match the trace\n", argv[i], mismatches);
+                    failed = 1;
+                }
+            } catch(runtime_error &re) {
+                printf("%s: %s\n", argv[i], re.what());
+                failed = 1;
+            }
+        }
+        delete rom;
+    } catch(runtime_error &re) {
+        cout << "unexpected error: " << re.what() << endl;
+        return 1;
+    }
+    return failed;
+}
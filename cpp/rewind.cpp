@@ -0,0 +1,324 @@
+/**
+ * @file rewind.cpp
+ * @author Carl Edwards
+ *
+ * Rewind buffer for the TMS1100 C++ library.
+ */
+#include <string>
+#include <cstring>
+#include <chrono>
+#include <algorithm>
+#include "rewind.h"
+
+using namespace std;
+
+Rewind::Rewind(TMS1100 *cpu, const IOPorts &host, unsigned long interval, unsigned long budget) {
+    cpu_ = cpu;
+    host_ = host;
+    interval_ = interval > 0 ? interval : 1;
+    budget_ = budget;
+    since_key_ = 0;
+    memory_ = 0;
+    last_k_ = -1;
+    replaying_ = false;
+    replay_k_ = 0;
+    last_seek_us_ = 0;
+    max_seek_us_ = 0;
+
+    IOPorts ports;
+    ports.ctx = this;
+    ports.output_r = output_r;
+    ports.output_o = output_o;
+    ports.input_k = input_k;
+    cpu_->set_io(ports);
+
+    // the first frame is taken right away so the window starts here
+    next_capture_ = cpu_->get_cycle();
+    capture();
+}
+
+Rewind::~Rewind() {
+    cpu_->set_io(host_);
+}
+
+void Rewind::output_r(void *ctx, int index, bool val) {
+    Rewind *rewind = (Rewind *)ctx;
+    if (rewind->host_.output_r) {
+        rewind->host_.output_r(rewind->host_.ctx, index, val);
+    }
+}
+
+void Rewind::output_o(void *ctx, int val) {
+    Rewind *rewind = (Rewind *)ctx;
+    if (rewind->host_.output_o) {
+        rewind->host_.output_o(rewind->host_.ctx, val);
+    }
+}
+
+/*
+ * Live: ask the host and log the value when it changes. Replaying: the
+ * value in effect at the current cycle comes from the log.
+ */
+int Rewind::input_k(void *ctx, int o_reg) {
+    Rewind *rewind = (Rewind *)ctx;
+    unsigned long long cycle = rewind->cpu_->get_cycle();
+    deque<KChange> &log = rewind->k_log_;
+
+    if (rewind->replaying_) {
+        while (rewind->replay_k_ + 1 < log.size() && log[rewind->replay_k_ + 1].cycle <= cycle) {
+            rewind->replay_k_++;
+        }
+        if (rewind->replay_k_ < log.size() && log[rewind->replay_k_].cycle <= cycle) {
+            return log[rewind->replay_k_].k;
+        }
+        return 0;
+    }
+
+    int k = rewind->host_.input_k ? rewind->host_.input_k(rewind->host_.ctx, o_reg) : 0;
+    if (k != rewind->last_k_) {
+        KChange change;
+        change.cycle = cycle;
+        change.k = k;
+        log.push_back(change);
+        rewind->memory_ += sizeof(KChange);
+        rewind->last_k_ = k;
+    }
+    return k;
+}
+
+unsigned long Rewind::frame_memory(const Frame &frame) {
+    return sizeof(Frame) + frame.data.capacity();
+}
+
+/*
+ * XOR against the previous state, coded as (zero count, literal count,
+ * literals...) runs. Consecutive snapshots differ in a handful of bytes.
+ */
+void Rewind::encode(const MachineState &prev, const MachineState &state, vector<BYTE> &data) {
+    const BYTE *a = (const BYTE *)&prev;
+    const BYTE *b = (const BYTE *)&state;
+    BYTE out[sizeof(MachineState) * 3 / 2 + 2];
+    int size = sizeof(MachineState);
+    int pos = 0;
+    int len = 0;
+
+    while (pos < size) {
+        int zeros = 0;
+        while (pos < size && zeros < 255 && a[pos] == b[pos]) {
+            zeros++;
+            pos++;
+        }
+        int start = pos;
+        while (pos < size && pos - start < 255 && a[pos] != b[pos]) {
+            pos++;
+        }
+        out[len++] = zeros;
+        out[len++] = pos - start;
+        for (int i = start; i < pos; i++) {
+            out[len++] = a[i] ^ b[i];
+        }
+    }
+    data.assign(out, out + len);
+}
+
+void Rewind::decode(const vector<BYTE> &data, MachineState &state) {
+    BYTE *b = (BYTE *)&state;
+    int pos = 0;
+    unsigned long i = 0;
+    while (i + 1 < data.size()) {
+        pos += data[i++];
+        int literals = data[i++];
+        for (int j = 0; j < literals; j++) {
+            b[pos++] ^= data[i++];
+        }
+    }
+}
+
+void Rewind::state_at(unsigned long frame, MachineState &state) {
+    unsigned long key = frame;
+    while (!frames_[key].key) {
+        key--;
+    }
+    memcpy(&state, frames_[key].data.data(), sizeof state);
+    for (unsigned long i = key + 1; i <= frame; i++) {
+        decode(frames_[i].data, state);
+    }
+}
+
+void Rewind::add_frame(const MachineState &state) {
+    frames_.emplace_back();
+    Frame &frame = frames_.back();
+    frame.cycle = state.cycle;
+    if (frames_.size() == 1 || since_key_ >= REWIND_KEY_FRAMES - 1) {
+        frame.key = true;
+        frame.data.assign((const BYTE *)&state, (const BYTE *)&state + sizeof state);
+        since_key_ = 0;
+    }
+    else {
+        frame.key = false;
+        encode(last_, state, frame.data);
+        since_key_++;
+    }
+    memory_ += frame_memory(frame);
+    last_ = state;
+
+    while (memory_ > budget_ && frames_.size() > 1) {
+        drop_oldest();
+    }
+}
+
+/*
+ * The oldest frame is always a key frame, so the one after it has to be
+ * made whole before the oldest can go.
+ */
+void Rewind::drop_oldest() {
+    Frame &next = frames_[1];
+    if (!next.key) {
+        MachineState state;
+        state_at(1, state);
+        memory_ -= frame_memory(next);
+        next.key = true;
+        next.data.assign((const BYTE *)&state, (const BYTE *)&state + sizeof state);
+        memory_ += frame_memory(next);
+        if (frames_.size() == 2) {
+            since_key_ = 0;
+        }
+    }
+    memory_ -= frame_memory(frames_.front());
+    frames_.pop_front();
+
+    // keep the K value in effect at the new oldest frame
+    while (k_log_.size() > 1 && k_log_[1].cycle <= frames_.front().cycle) {
+        k_log_.pop_front();
+        memory_ -= sizeof(KChange);
+    }
+}
+
+void Rewind::truncate_after(unsigned long long cycle) {
+    while (frames_.back().cycle > cycle) {
+        memory_ -= frame_memory(frames_.back());
+        frames_.pop_back();
+    }
+    // a K read at 'cycle' belongs to the instruction that runs next
+    while (!k_log_.empty() && k_log_.back().cycle >= cycle) {
+        k_log_.pop_back();
+        memory_ -= sizeof(KChange);
+    }
+    last_k_ = -1;
+
+    since_key_ = 0;
+    for (unsigned long i = frames_.size() - 1; !frames_[i].key; i--) {
+        since_key_++;
+    }
+    state_at(frames_.size() - 1, last_);
+    next_capture_ = frames_.back().cycle + interval_;
+}
+
+void Rewind::capture() {
+    if (cpu_->get_cycle() >= next_capture_) {
+        MachineState state;
+        cpu_->save_state(state);
+        add_frame(state);
+        next_capture_ = state.cycle + interval_;
+    }
+}
+
+unsigned long Rewind::run(unsigned long cycles) {
+    unsigned long count = 0;
+    while (count < cycles) {
+        capture();
+        unsigned long chunk = min((unsigned long long)(cycles - count), next_capture_ - cpu_->get_cycle());
+        unsigned long executed = cpu_->run(chunk);
+        count += executed;
+        if (executed < chunk) {
+            break;  // stop() was called
+        }
+    }
+    capture();
+    return count;
+}
+
+bool Rewind::seek(unsigned long long cycle) {
+    auto start = chrono::steady_clock::now();
+    if (cycle < frames_.front().cycle || cycle > cpu_->get_cycle()) {
+        return false;
+    }
+
+    unsigned long frame = frames_.size() - 1;
+    while (frames_[frame].cycle > cycle) {
+        frame--;
+    }
+    MachineState state;
+    state_at(frame, state);
+
+    // replay from the snapshot with the logged K values and no output
+    KChange key;
+    key.cycle = state.cycle;
+    replay_k_ = upper_bound(k_log_.begin(), k_log_.end(), key,
+        [](const KChange &a, const KChange &b) { return a.cycle < b.cycle; }) - k_log_.begin();
+    replay_k_ = replay_k_ > 0 ? replay_k_ - 1 : 0;
+    replaying_ = true;
+    cpu_->set_output_muted(true);
+    cpu_->load_state(state);
+    while (cpu_->get_cycle() < cycle) {
+        if (cpu_->run(cycle - cpu_->get_cycle()) == 0) {
+            break;
+        }
+    }
+    cpu_->set_output_muted(false);
+    replaying_ = false;
+
+    truncate_after(cycle);
+
+    // restoring the state again reports the R lines and O to the host
+    cpu_->save_state(state);
+    cpu_->load_state(state);
+
+    chrono::duration<double, micro> elapsed = chrono::steady_clock::now() - start;
+    last_seek_us_ = elapsed.count();
+    max_seek_us_ = max(max_seek_us_, last_seek_us_);
+    return true;
+}
+
+bool Rewind::rewind(unsigned long long cycles) {
+    unsigned long long now = cpu_->get_cycle();
+    if (cycles > now) {
+        return false;
+    }
+    return seek(now - cycles);
+}
+
+void Rewind::set_budget(unsigned long budget) {
+    budget_ = budget;
+    while (memory_ > budget_ && frames_.size() > 1) {
+        drop_oldest();
+    }
+}
+
+unsigned long Rewind::get_memory() {
+    return memory_;
+}
+
+unsigned long Rewind::get_frames() {
+    return frames_.size();
+}
+
+unsigned long Rewind::get_k_changes() {
+    return k_log_.size();
+}
+
+unsigned long long Rewind::get_oldest_cycle() {
+    return frames_.front().cycle;
+}
+
+unsigned long long Rewind::get_window_cycles() {
+    return cpu_->get_cycle() - frames_.front().cycle;
+}
+
+double Rewind::get_last_seek_us() {
+    return last_seek_us_;
+}
+
+double Rewind::get_max_seek_us() {
+    return max_seek_us_;
+}
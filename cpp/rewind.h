@@ -0,0 +1,107 @@
+/**
+ * @file rewind.h
+ * @author Carl Edwards
+ *
+ * Rewind buffer for the TMS1100 C++ library.
+ *
+ * Takes a MachineState snapshot every 'interval' cycles and keeps them in
+ * a ring bounded by a memory budget. Each snapshot is stored as a XOR
+ * against the previous one, run-length encoded, with a full key frame
+ * every REWIND_KEY_FRAMES snapshots to bound the seek cost. The K input
+ * values between snapshots are logged, so seek() can restore the nearest
+ * snapshot and replay to any cycle in the window exactly.
+ *
+ * The Rewind owns the cpu's I/O ports and forwards them to the host's.
+ */
+#ifndef REWIND_H
+#define REWIND_H
+
+#include <deque>
+#include <vector>
+#include "tms1xx0.h"
+
+// default cycles between snapshots, ~0.1s of Merlin time
+#define REWIND_INTERVAL 5000
+
+// default memory budget in bytes
+#define REWIND_BUDGET (1024 * 1024)
+
+// every n-th snapshot is stored whole instead of as a delta
+#define REWIND_KEY_FRAMES 32
+
+class Rewind {
+    private:
+    struct Frame {
+        unsigned long long cycle;
+        bool key;                   // data is a whole MachineState
+        std::vector<BYTE> data;     // else a RLE coded XOR against the previous frame
+    };
+
+    // K input value change
+    struct KChange {
+        unsigned long long cycle;
+        BYTE k;
+    };
+
+    TMS1100 *cpu_;
+    IOPorts host_;
+    unsigned long interval_;
+    unsigned long budget_;
+
+    std::deque<Frame> frames_;
+    std::deque<KChange> k_log_;
+    MachineState last_;             // state of the newest frame
+    unsigned long long next_capture_;
+    int since_key_;
+    unsigned long memory_;
+    int last_k_;
+
+    // replay state, used while seek() runs the cpu forward
+    bool replaying_;
+    unsigned long replay_k_;
+
+    double last_seek_us_;
+    double max_seek_us_;
+
+    static void output_r(void *ctx, int index, bool val);
+    static void output_o(void *ctx, int val);
+    static int input_k(void *ctx, int o_reg);
+
+    static unsigned long frame_memory(const Frame &);
+    static void encode(const MachineState &prev, const MachineState &state, std::vector<BYTE> &data);
+    static void decode(const std::vector<BYTE> &data, MachineState &state);
+    void state_at(unsigned long frame, MachineState &state);
+    void add_frame(const MachineState &state);
+    void drop_oldest();
+    void truncate_after(unsigned long long cycle);
+
+    public:
+    Rewind(TMS1100 *cpu, const IOPorts &host, unsigned long interval = REWIND_INTERVAL,
+        unsigned long budget = REWIND_BUDGET);
+    ~Rewind();
+
+    // run the cpu, capturing snapshots on the way. Returns the number of
+    // instructions executed.
+    unsigned long run(unsigned long cycles);
+
+    // for hosts that run the cpu themselves: take a snapshot if one is due
+    void capture();
+
+    // go back to 'cycle', anything recorded after it is discarded. Returns
+    // false if the cycle is outside the window.
+    bool seek(unsigned long long cycle);
+    bool rewind(unsigned long long cycles);
+
+    void set_budget(unsigned long budget);
+
+    // statistics
+    unsigned long get_memory();
+    unsigned long get_frames();
+    unsigned long get_k_changes();
+    unsigned long long get_oldest_cycle();
+    unsigned long long get_window_cycles();
+    double get_last_seek_us();
+    double get_max_seek_us();
+};
+
+#endif
@@ -14,358 +14,964 @@
 #include <fstream>
 #include <vector>
 #include <sstream>
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <cstdio>
+#include <climits>
+#include <map>
+#include <mutex>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include "tms1xx0.h"
+#include "output_ring.h"
 using namespace std; 
 
-#define SET1(X) (X & 0x01)
-#define SET2(X) (X & 0x03)
-#define SET3(X) (X & 0x07)
-#define SET4(X) (X & 0x0F)
-#define SET6(X) (X & 0x3F)
-#define NOT4(X) ((~X) & 0x0F)
-#define CURR_RAM (ram_[(cpu_->get_x() << 4) | cpu_->get_y()])
+#define SET1(X) ((X) & 0x01)
+#define SET2(X) ((X) & 0x03)
+#define SET3(X) ((X) & 0x07)
+#define SET4(X) ((X) & 0x0F)
+#define SET6(X) ((X) & 0x3F)
+#define NOT4(X) ((~(X)) & 0x0F)
+#define CURR_RAM (cpu_.get_ram())
 // #define DEBUG_FUNCTION printf("func: %s\n", __FUNCTION__)
 #define DEBUG_FUNCTION 
 
-static BYTE pc_sequence[64] = {
-    0x00, 0x01, 0x03, 0x07, 0x0F, 0x1F, 0x3F, 0x3E,
-    0x3D, 0x3B, 0x37, 0x2F, 0x1E, 0x3C, 0x39, 0x33,
-    0x27, 0x0E, 0x1D, 0x3A, 0x35, 0x2B, 0x16, 0x2C,
-    0x18, 0x30, 0x21, 0x02, 0x05, 0x0B, 0x17, 0x2E,
-    0x1C, 0x38, 0x31, 0x23, 0x06, 0x0D, 0x1B, 0x36,
-    0x2D, 0x1A, 0x34, 0x29, 0x12, 0x24, 0x08, 0x11,
-    0x22, 0x04, 0x09, 0x13, 0x26, 0x0C, 0x19, 0x32,
-    0x25, 0x0A, 0x15, 0x2A, 0x14, 0x28, 0x10, 0x20
-};
+/*
+ * The PC is a 6 bit LFSR, the next PC shifts in the XNOR of bits 5 and 4
+ * with 0x1F and 0x3F swapped so the sequence covers all 64 addresses.
+ * sequence[n] is the PC after n increments from 0, inverse[pc] is n.
+ */
+struct PcSequence {
+    BYTE sequence[64];
+    BYTE inverse[64];
+
+    constexpr PcSequence() : sequence(), inverse() {
+        BYTE pc = 0;
+        for (int i = 0; i < 64; i++) {
+            sequence[i] = pc;
+            inverse[pc] = i;
+            BYTE feed = ((pc >> 5 ^ pc >> 4) & 1) ^ 1;
+            if (pc == 0x1F || pc == 0x3F) {
+                feed ^= 1;
+            }
+            pc = ((pc << 1) | feed) & 0x3F;
+        }
+    }
 
-BYTE inverseSequence(BYTE addr) {
-    for (BYTE i = 0; i < 64; ++i) {
-        if (pc_sequence[i] == addr) {
-            return i;
+    constexpr bool is_permutation() const {
+        for (int i = 0; i < 64; i++) {
+            if (inverse[sequence[i]] != i) {
+                return false;
+            }
         }
+        return true;
     }
-    throw runtime_error("inverseSequence: can't happen");
-}
+};
 
-ROM::ROM() {
-    rom_size_ = 0;
-    data_ = NULL;
-}
+static constexpr PcSequence pc_sequence;
+static_assert(pc_sequence.is_permutation(), "PC sequence doesn't cover every address");
+static_assert(pc_sequence.sequence[7] == 0x3E && pc_sequence.sequence[63] == 0x20,
+    "PC sequence doesn't match the TMS1100");
+
+/*
+ * Opcode to handler id and decoded constant, used by ROM::load_rom()
+ * to predecode every ROM word.
+ */
+struct DecodeTable {
+    Instruction op[256];
+    constexpr DecodeTable();
+};
 
-BYTE ROM::get_data(WORD index) {
-    if (index < 0 || index >= rom_size_) {
-        std::ostringstream oss;
-        oss << "rom.get_data index '" << index << "' out of of range: " << rom_size_;
-        throw runtime_error(oss.str());
+constexpr DecodeTable::DecodeTable() : op() {
+    for (int i = 0; i <= 255; i++) {
+        op[i].op = OP_INVALID;
+        op[i].arg = 0;
+        op[i].len = 1;
+        op[i].block_len = 1;
     }
-    return data_[index];
-}
 
-void ROM::load_rom(std::string filename) {
-    ifstream ifd(filename, ios::binary | ios::in | ios::ate);
-    if (!ifd.is_open()) {
-        throw runtime_error("error opening file: " + filename);
+    op[0x20].op = OP_TAY;
+    op[0x23].op = OP_TYA;
+    op[0x7f].op = OP_CLA;
+
+    // transfer register to memory
+    op[0x27].op = OP_TAM;
+    op[0x25].op = OP_TAMIYC;
+    op[0x24].op = OP_TAMDYN;
+    op[0x26].op = OP_TAMZA;
+
+    // memory to register
+    op[0x22].op = OP_TMY;
+    op[0x21].op = OP_TMA;
+    op[0x03].op = OP_XMA;
+
+    // arithmetic
+    op[0x06].op = OP_AMAAC;
+    op[0x3c].op = OP_SAMAN;
+    op[0x3e].op = OP_IMAC;
+
+    op[0x07].op = OP_DMAN;
+
+    // ia, a9aac, a5aac, a13aac, a3aac, a11aac, a7aac, dan, a2aac, a10aac, a6aac
+    // a14aac, a4aac, a12aac, a8aac
+    BYTE op_constants_0[] = {1, 9, 5, 13, 3, 11, 7, 15, 2, 10, 6, 14, 4, 12, 8};
+    for (BYTE i = 0; i < sizeof(op_constants_0)/sizeof op_constants_0[0]; i++) {
+        BYTE op_index = 0x70 + i;
+        op[op_index].op = OP_A_AAC;
+        op[op_index].arg = op_constants_0[i];
     }
-    int size = ifd.tellg();
-    ifd.seekg(0, ios::beg);
-    std::vector<char> buffer;
-    buffer.resize(size);
-    ifd.read(buffer.data(), size);
-
-	// Rearrange the ROM according to the PC sequence
-	// so it appear as linear (and then we can simply 
-	// increment PC)
-    unsigned char *remappedROM = new unsigned char[size];
-
-    for (int i = 0; i < size; ++i) {
-        // remappedROM[i] = buffer[i];
-        // Remap memory addresses
-        remappedROM[i] = buffer[i & 0xFFC0 | pc_sequence[i & 0x3F]];
-
-        // Remap branch and jump instructions
-        if (remappedROM[i] & 0x80) {
-            BYTE newAddress = inverseSequence(remappedROM[i] & 0x3F);
-            remappedROM[i] &= 0xC0; // Keep opcode
-            remappedROM[i] |= newAddress; // new operand
-        }
+
+    op[0x05].op = OP_IYC;
+    op[0x04].op = OP_DYN;
+    op[0x3d].op = OP_CPAIZ;
+
+    // arithmetic compare
+    op[0x01].op = OP_ALEM;
+
+    // logical compare
+    op[0x00].op = OP_MNEA;
+    op[0x3f].op = OP_MNEZ;
+    op[0x02].op = OP_YNEA;
+
+    BYTE op_constants_1[] = {0, 8, 4, 12, 2, 10, 6, 14, 1, 9, 5, 13, 3, 11, 7, 15};
+    for (BYTE i = 0; i < sizeof(op_constants_1)/sizeof op_constants_1[0]; i++) {
+        BYTE op_index = 0x10 + i;
+        op[op_index].op = OP_LDP;
+        op[op_index].arg = op_constants_1[i];
+        op_index = 0x40 + i;
+        op[op_index].op = OP_TCY;
+        op[op_index].arg = op_constants_1[i];
+        op_index = 0x50 + i;
+        op[op_index].op = OP_YNEC;
+        op[op_index].arg = op_constants_1[i];
+        op_index = 0x60 + i;
+        op[op_index].op = OP_TCMIY;
+        op[op_index].arg = op_constants_1[i];
     }
 
-    delete data_;
-    data_ = remappedROM;
-    rom_size_ = size;
-}
+    // bits in memory
+    op[0x09].op = OP_COMX;
+    op[0x0b].op = OP_COMC;
 
-CPUState :: CPUState() {
-    output_r_cb_ = NULL;
-    output_o_cb_ = NULL;
-    input_k_cb_ = NULL;
-    set_x(0xAA);
-    set_y(0xAA);
-    set_a(0xAA);
-    set_s(false);
-    set_sl(false);
-    set_sr(0x00);
-    set_pc(0x00);
-    set_pa(0xFF);
-    set_pb(0xFF);
-    set_k(0x00);
-    set_cl(false);
-    set_o(0);
+    BYTE op_constants_2[] = {0, 2, 1, 3};
+    for (BYTE i = 0; i < sizeof(op_constants_2)/sizeof op_constants_2[0]; i++) {
+        BYTE op_index = 0x30 + i;
+        op[op_index].op = OP_SBIT;
+        op[op_index].arg = op_constants_2[i];
+        op_index = 0x34 + i;
+        op[op_index].op = OP_RBIT;
+        op[op_index].arg = op_constants_2[i];
+        op_index = 0x38 + i;
+        op[op_index].op = OP_TBIT1;
+        op[op_index].arg = op_constants_2[i];
+    }
 
-    for (int i = 0; i < R_WIDTH; i++) {
-        reg_r_[i] = false;
+    // input
+    op[0x0e].op = OP_KNEZ;
+    op[0x08].op = OP_TKA;
+
+    // output
+    op[0x0d].op = OP_SETR;
+    op[0x0c].op = OP_RSTR;
+    op[0x0a].op = OP_TDO;
+
+    // ram 'x' addressing
+    BYTE op_constants_3[] = {0, 4, 2, 6, 1, 5, 3, 7};
+    for (BYTE i = 0; i < sizeof(op_constants_3)/sizeof op_constants_3[0]; i++) {
+        BYTE op_index = 0x28 + i;
+        op[op_index].op = OP_LDX;
+        op[op_index].arg = op_constants_3[i];
     }
 
-    set_ca(0);
-    set_cb(0);
-    set_cs(0);
+    // addressing, the operand is the (remapped) pc of the target
+    for (BYTE i = 0; i < 0x40; i++) {
+        op[0x80 + i].op = OP_BR;
+        op[0x80 + i].arg = i;
+        op[0xC0 + i].op = OP_CALL;
+        op[0xC0 + i].arg = i;
+    }
+
+    op[0x0f].op = OP_RETN;
 }
 
-void CPUState::increment_pc() {
-    reg_pc_ = SET6(reg_pc_ + 1);
+static constexpr DecodeTable decode_table;
+
+static constexpr bool ends_block(BYTE op) {
+    return op == OP_BR || op == OP_CALL || op == OP_RETN;
 }
 
-BYTE CPUState::get_pc() {
-    return reg_pc_;
+// address of the n-th word after 'index', PC wraps within its page
+static constexpr WORD next_address(WORD index, int n) {
+    return (index & 0xFFC0) | ((index + n) & 0x3F);
 }
 
-void CPUState::set_pc(BYTE pc) {
-    reg_pc_ = SET6(pc);
+/*
+ * The load stages are constexpr so an embedded ROM can go through them
+ * at compile time.
+ *
+ * Rearrange the ROM according to the PC sequence so it appears as linear
+ * (and then we can simply increment PC). Branch and call operands become
+ * the position of their target in the sequence. 'data' covers the whole
+ * address space, words past the end of 'raw' are 0.
+ */
+static constexpr void remap_rom(const BYTE *raw, int size, BYTE *data) {
+    for (int i = 0; i < ROM_WORDS; ++i) {
+        int from = (i & 0xFFC0) | pc_sequence.sequence[i & 0x3F];
+        data[i] = from < size ? raw[from] : 0;
+        if (data[i] & 0x80) {
+            data[i] = (data[i] & 0xC0) | pc_sequence.inverse[data[i] & 0x3F];
+        }
+    }
 }
 
-BYTE CPUState::get_pa() {
-    return reg_pa_;
+// Decode every word once so step() doesn't have to
+static constexpr void decode_rom(const BYTE *data, Instruction *code) {
+    for (int i = 0; i < ROM_WORDS; ++i) {
+        code[i] = decode_table.op[data[i]];
+    }
 }
 
-void CPUState::set_pa(BYTE pa) {
-    reg_pa_ = SET4(pa);
+/*
+ * Split the ROM into straight-line basic blocks ending at BR/CALL/RETN and
+ * fuse common instruction sequences. blocks[i] is the (possibly fused)
+ * instruction starting at address i and block_len the number of words from
+ * i up to and including the block terminator.
+ *
+ * Blocks are keyed by the full CA/PA/PC address and the PC wraps within its
+ * page, so a page or chapter change lands on another block and nothing has
+ * to be invalidated until the next load_rom().
+ */
+static constexpr void translate_rom(Instruction *code, Instruction *blocks) {
+    // block_len counted back from the terminators, twice around the page
+    // so the words after the last terminator see the first one. A page
+    // without a terminator is cut after 64 words.
+    for (int page = 0; page < ROM_WORDS; page += 64) {
+        int block_len = 64;
+        for (int n = 127; n >= 0; n--) {
+            int i = page + (n & 0x3F);
+            block_len = ends_block(code[i].op) ? 1 : std::min(block_len + 1, 64);
+            if (n < 64) {
+                code[i].block_len = block_len;
+            }
+        }
+    }
+
+    for (int i = 0; i < ROM_WORDS; ++i) {
+        int block_len = code[i].block_len;
+        Instruction ins = code[i];
+        const Instruction &next = code[next_address(i, 1)];
+        const Instruction &third = code[next_address(i, 2)];
+
+        // only fuse words ahead of the terminator
+        if (ins.op == OP_LDX && next.op == OP_TCY && block_len > 2) {
+            ins.arg = (ins.arg << 4) | next.arg;
+            if (third.op == OP_TMA && block_len > 3) {
+                ins.op = OP_LDX_TCY_TMA;
+                ins.len = 3;
+            }
+            else {
+                ins.op = OP_LDX_TCY;
+                ins.len = 2;
+            }
+        }
+        else if (ins.op == OP_TCY && next.op == OP_TMA && block_len > 2) {
+            ins.op = OP_TCY_TMA;
+            ins.len = 2;
+        }
+        else if (ins.op == OP_TCY && next.op == OP_TCMIY && block_len > 2) {
+            int len = 2;
+            while (len < block_len - 1 && len <= 15 && code[next_address(i, len)].op == OP_TCMIY) {
+                len++;
+            }
+            ins.op = OP_TCY_TCMIY;
+            ins.arg |= (len - 1) << 4;
+            ins.len = len;
+        }
+        else if (ins.op == OP_XMA && next.op == OP_DYN && block_len > 2) {
+            ins.op = OP_XMA_DYN;
+            ins.len = 2;
+        }
+        blocks[i] = ins;
+    }
 }
 
-BYTE CPUState::get_pb() {
-    return reg_pb_;
+/*
+ * A ROM file mapped read-only for the duration of a load.
+ */
+struct RomFile {
+    const BYTE *data;
+    int size;
+    RomFile(std::string filename);
+    ~RomFile();
+};
+
+RomFile::RomFile(std::string filename) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw runtime_error("error opening file: " + filename);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        throw runtime_error("not a ROM image: " + filename);
+    }
+    if (st.st_size > ROM_WORDS) {
+        ::close(fd);
+        throw runtime_error("ROM image larger than the address space: " + filename);
+    }
+    size = st.st_size;
+    void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        throw runtime_error("error mapping file: " + filename);
+    }
+    data = (const BYTE *)map;
 }
 
-void CPUState::set_pb(BYTE pb) {
-    reg_pb_ = SET4(pb);
+RomFile::~RomFile() {
+    munmap((void *)data, size);
 }
 
-bool CPUState::get_s() {
-    return reg_s_;
+static constexpr unsigned long long rom_hash(const BYTE *data, int size,
+        unsigned long long hash = 14695981039346656037ULL) {
+    for (int i = 0; i < size; i++) {
+        hash = (hash ^ data[i]) * 1099511628211ULL;
+    }
+    return hash;
 }
 
-void CPUState::set_s(bool val) {
-    reg_s_ = val;
+static_assert(sizeof(RomCacheHeader) == 32, "RomCacheHeader has padding holes");
+
+static std::string rom_cache_dir;
+
+// load_shared() images by hash
+static std::mutex shared_lock;
+static std::map<unsigned long long, ROM *> shared_roms;
+
+ROM::ROM() {
+    rom_size_ = 0;
+    hash_ = 0;
+    data_ = NULL;
+    code_ = NULL;
+    blocks_ = NULL;
+    map_ = NULL;
+    map_size_ = 0;
+    owned_ = false;
+    refs_ = 0;
 }
 
-bool CPUState::get_sl() {
-    return reg_sl_;
+ROM::~ROM() {
+    free_image();
 }
 
-void CPUState::set_sl(bool val) {
-    reg_sl_ = val;
+void ROM::free_image() {
+    if (map_) {
+        munmap(map_, map_size_);
+    }
+    else if (owned_) {
+        delete[] data_;
+        delete[] code_;
+        delete[] blocks_;
+    }
+    data_ = NULL;
+    code_ = NULL;
+    blocks_ = NULL;
+    map_ = NULL;
+    map_size_ = 0;
+    owned_ = false;
+    rom_size_ = 0;
 }
 
-BYTE CPUState::get_sr() {
-    return reg_sr_;
+void ROM::out_of_range(WORD index) {
+    std::ostringstream oss;
+    oss << "rom.get_data index '" << index << "' out of of range: " << rom_size_;
+    throw runtime_error(oss.str());
 }
 
-void CPUState::set_sr(BYTE val) {
-    reg_sr_ = val;
+unsigned long long ROM::get_hash() {
+    return hash_;
 }
 
-BYTE CPUState::get_a() {
-    return reg_a_;
+void ROM::load_rom(std::string filename) {
+    RomFile file(filename);
+    load_image(file.data, file.size, rom_hash(file.data, file.size));
+}
+
+void ROM::load_image(const BYTE *raw, int size, unsigned long long hash) {
+    std::string cache_path;
+    if (!rom_cache_dir.empty()) {
+        char name[32];
+        snprintf(name, sizeof name, "%016llx.mrlc", hash);
+        cache_path = rom_cache_dir + "/" + name;
+        if (load_cache(cache_path, size, hash)) {
+            return;
+        }
+    }
+
+    BYTE *data = new BYTE[ROM_WORDS];
+    Instruction *code = new Instruction[ROM_WORDS];
+    Instruction *blocks = new Instruction[ROM_WORDS];
+    remap_rom(raw, size, data);
+    decode_rom(data, code);
+    translate_rom(code, blocks);
+
+    free_image();
+    data_ = data;
+    code_ = code;
+    blocks_ = blocks;
+    owned_ = true;
+    rom_size_ = size;
+    hash_ = hash;
+
+    if (!cache_path.empty()) {
+        save_cache(cache_path);
+    }
 }
 
-void CPUState::set_a(BYTE val) {
-    reg_a_ = SET4(val);
+// FNV-1a over the arrays in file order
+static unsigned long long cache_checksum(const BYTE *data, const Instruction *code,
+        const Instruction *blocks) {
+    unsigned long long hash = rom_hash(data, ROM_WORDS);
+    hash = rom_hash((const BYTE *)code, ROM_WORDS * sizeof(Instruction), hash);
+    return rom_hash((const BYTE *)blocks, ROM_WORDS * sizeof(Instruction), hash);
 }
 
-BYTE CPUState::get_y() {
-    return reg_y_;
+/*
+ * The run loops dispatch on op and step by len without any checks, so a
+ * cache file has to hold instructions translate_rom() could have made:
+ * a known op, and a fused len within its block within the page.
+ */
+static bool valid_cache_code(const Instruction *code) {
+    for (int i = 0; i < 2 * ROM_WORDS; i++) {
+        const Instruction &ins = code[i];
+        if (ins.op >= OP_COUNT || ins.block_len < 1 || ins.block_len > 64
+                || ins.len < 1 || ins.len > ins.block_len
+                || (i < ROM_WORDS && ins.len != 1)) {
+            return false;
+        }
+    }
+    return true;
 }
 
-void CPUState::set_y(BYTE val) {
-    reg_y_ = SET4(val);
+/*
+ * Maps a cached image in place of remapping and decoding, false if there
+ * is no usable one. Anything that doesn't check out (header, checksum or
+ * the instructions themselves) makes the caller rebuild the image and
+ * rewrite the file.
+ */
+bool ROM::load_cache(std::string path, int size, unsigned long long hash) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    unsigned long expected = sizeof(RomCacheHeader) + ROM_WORDS * (1 + 2 * sizeof(Instruction));
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (unsigned long)st.st_size != expected) {
+        ::close(fd);
+        return false;
+    }
+    void *map = mmap(NULL, expected, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+    const RomCacheHeader *header = (const RomCacheHeader *)map;
+    const BYTE *data = (const BYTE *)(header + 1);
+    const Instruction *code = (const Instruction *)(data + ROM_WORDS);
+    if (memcmp(header->magic, ROM_CACHE_MAGIC, sizeof header->magic) != 0
+            || header->version != ROM_CACHE_VERSION || header->instruction_size != sizeof(Instruction)
+            || header->size != (unsigned int)size || header->hash != hash
+            || header->checksum != cache_checksum(data, code, code + ROM_WORDS)
+            || !valid_cache_code(code)) {
+        munmap(map, expected);
+        return false;
+    }
+
+    free_image();
+    map_ = map;
+    map_size_ = expected;
+    data_ = data;
+    code_ = code;
+    blocks_ = code + ROM_WORDS;
+    rom_size_ = size;
+    hash_ = hash;
+    return true;
 }
 
-void CPUState::inc_y() {
-    set_y(reg_y_ + 1);
+/*
+ * Best effort, a cache that can't be written only costs the next load
+ * the remap. The file is renamed into place so concurrent loads never
+ * see half of it.
+ */
+void ROM::save_cache(std::string path) {
+    RomCacheHeader header;
+    memset(&header, 0, sizeof header);
+    memcpy(header.magic, ROM_CACHE_MAGIC, sizeof header.magic);
+    header.version = ROM_CACHE_VERSION;
+    header.instruction_size = sizeof(Instruction);
+    header.size = rom_size_;
+    header.hash = hash_;
+    header.checksum = cache_checksum(data_, code_, blocks_);
+
+    std::string temp = path + "." + to_string(getpid());
+    ofstream ofd(temp, ios::binary | ios::out | ios::trunc);
+    if (!ofd.is_open()) {
+        return;
+    }
+    ofd.write((const char *)&header, sizeof header);
+    ofd.write((const char *)data_, ROM_WORDS);
+    ofd.write((const char *)code_, ROM_WORDS * sizeof(Instruction));
+    ofd.write((const char *)blocks_, ROM_WORDS * sizeof(Instruction));
+    ofd.close();
+    if (!ofd || rename(temp.c_str(), path.c_str()) != 0) {
+        remove(temp.c_str());
+    }
 }
 
-void CPUState::dec_y() {
-    set_y(reg_y_ - 1);
+#ifdef TMS1100_EMBEDDED_ROM
+#include "mp3404_rom.h"
+
+/*
+ * mp3404.bin remapped, decoded and translated by the compiler.
+ */
+struct EmbeddedRom {
+    BYTE data[ROM_WORDS];
+    Instruction code[ROM_WORDS];
+    Instruction blocks[ROM_WORDS];
+    unsigned long long hash;
+
+    constexpr EmbeddedRom() : data(), code(), blocks(), hash(rom_hash(mp3404_rom, MP3404_ROM_SIZE)) {
+        remap_rom(mp3404_rom, MP3404_ROM_SIZE, data);
+        decode_rom(data, code);
+        translate_rom(code, blocks);
+    }
+};
+
+static_assert(MP3404_ROM_SIZE <= ROM_WORDS, "mp3404_rom.h doesn't fit the address space");
+
+static constexpr EmbeddedRom embedded_rom;
+
+void ROM::load_embedded() {
+    free_image();
+    data_ = embedded_rom.data;
+    code_ = embedded_rom.code;
+    blocks_ = embedded_rom.blocks;
+    rom_size_ = MP3404_ROM_SIZE;
+    hash_ = embedded_rom.hash;
 }
+#endif
 
-BYTE CPUState::get_x() {
-    return reg_x_;
+void ROM::set_cache_dir(std::string dir) {
+    if (!dir.empty()) {
+        mkdir(dir.c_str(), 0755);
+    }
+    rom_cache_dir = dir;
 }
 
-void CPUState::set_x(BYTE val) {
-    reg_x_ = SET3(val);
+ROM *ROM::load_shared(std::string filename) {
+    RomFile file(filename);
+    unsigned long long hash = rom_hash(file.data, file.size);
+
+    std::lock_guard<std::mutex> lock(shared_lock);
+    auto found = shared_roms.find(hash);
+    if (found != shared_roms.end()) {
+        found->second->refs_++;
+        return found->second;
+    }
+    ROM *rom = new ROM();
+    try {
+        rom->load_image(file.data, file.size, hash);
+    } catch (...) {
+        delete rom;
+        throw;
+    }
+    rom->refs_ = 1;
+    shared_roms[hash] = rom;
+    return rom;
 }
 
-void CPUState::com_x() {
-    reg_x_ = SET3(reg_x_ ^ 4);
+void ROM::release() {
+    {
+        std::lock_guard<std::mutex> lock(shared_lock);
+        if (--refs_ > 0) {
+            return;
+        }
+        shared_roms.erase(hash_);
+    }
+    delete this;
 }
 
-void CPUState::com_cb() {
-    reg_cb_ = SET1(~reg_cb_);
+CPUState :: CPUState() {
+    // the hot state has to stay within the first two cache lines
+    static_assert(offsetof(CPUState, ram_) + sizeof ram_ <= 128, "CPUState hot state outgrew two cache lines");
+    static_assert(alignof(CPUState) == 64, "CPUState isn't cache line aligned");
+    output_r_cb_ = NULL;
+    output_r_ctx_ = NULL;
+    output_o_cb_ = NULL;
+    output_o_ctx_ = NULL;
+    input_k_cb_ = NULL;
+    input_k_ctx_ = NULL;
+    output_batch_cb_ = NULL;
+    output_batch_ctx_ = NULL;
+    plain_r_cb_ = NULL;
+    plain_o_cb_ = NULL;
+    plain_k_cb_ = NULL;
+    plain_batch_cb_ = NULL;
+    output_ring_ = NULL;
+    change_only_ = false;
+    muted_ = false;
+    events_ = NULL;
+    event_count_ = 0;
+    cycle_ = 0;
+    last_key_cycle_ = 0;
+    set_x(0xAA);
+    set_y(0xAA);
+    set_a(0xAA);
+    set_s(false);
+    set_sl(false);
+    set_sr(0x00);
+    set_pc(0x00);
+    set_pa(0xFF);
+    set_pb(0xFF);
+    set_k(0x00);
+    set_cl(false);
+    set_o(0);
+
+    reg_r_ = 0;
+    memset(ram_, 0xAA, sizeof ram_);
+
+    set_ca(0);
+    set_cb(0);
+    set_cs(0);
 }
 
 BYTE CPUState::get_k() {
     if (input_k_cb_) {
-        set_k(input_k_cb_(reg_o_));
+        set_k(input_k_cb_(input_k_ctx_, reg_.o));
+        if (reg_.k) {
+            last_key_cycle_ = cycle_;
+        }
     }
-    return reg_k_;
+    return reg_.k;
 }
 
-void CPUState::set_k(BYTE val) {
-    reg_k_ = SET4(val);
+CPUState::~CPUState() {
+    delete[] events_;
+}
+
+void CPUState::output(BYTE type, BYTE index, BYTE value) {
+    if (muted_) {
+        return;
+    }
+    if (output_ring_) {
+        OutputEvent event;
+        event.cycle = cycle_;
+        event.type = type;
+        event.index = index;
+        event.value = value;
+        output_ring_->push(event);
+    }
+    else if (output_batch_cb_) {
+        OutputEvent &event = events_[event_count_++];
+        event.cycle = cycle_;
+        event.type = type;
+        event.index = index;
+        event.value = value;
+        if (event_count_ == OUTPUT_BUFFER_SIZE) {
+            flush_output();
+        }
+    }
+    else if (type == OUTPUT_R) {
+        if (output_r_cb_) {
+            output_r_cb_(output_r_ctx_, index, value);
+        }
+    }
+    else if (output_o_cb_) {
+        output_o_cb_(output_o_ctx_, value);
+    }
+}
+
+void CPUState::flush_output() {
+    if (event_count_ > 0) {
+        int count = event_count_;
+        event_count_ = 0;
+        if (output_batch_cb_) {
+            output_batch_cb_(output_batch_ctx_, events_, count);
+        }
+    }
 }
 
 void CPUState::set_r_index(BYTE index) {
     if (index >=0 && index < R_WIDTH) {
-        reg_r_[index] = true;
-        if (output_r_cb_) {
-            output_r_cb_(index, true);
+        if (change_only_ && (reg_r_ & (1 << index))) {
+            return;
         }
+        reg_r_ |= 1 << index;
+        output(OUTPUT_R, index, true);
     }
 }
 
 void CPUState::rst_r_index(BYTE index) {
     if (index >=0 && index < R_WIDTH) {
-        reg_r_[index] = false;
-        if (output_r_cb_) {
-            output_r_cb_(index, false);
+        if (change_only_ && !(reg_r_ & (1 << index))) {
+            return;
         }
+        reg_r_ &= ~(1 << index);
+        output(OUTPUT_R, index, false);
     }
 }
 
 void CPUState::set_o(BYTE val) {
     // TODO check on max bits for O
-    reg_o_ = val;
-    if (output_o_cb_) {
-        output_o_cb_(reg_o_);
+    if (change_only_ && reg_.o == val) {
+        return;
     }
+    reg_.o = val;
+    output(OUTPUT_O, 0, reg_.o);
 }
 
-bool CPUState::get_cl() {
-    return reg_cl_;
-}
-void CPUState::set_cl(bool val) {
-    reg_cl_ = val;
+void CPUState::plain_r(void *ctx, int index, bool val) {
+    ((CPUState *)ctx)->plain_r_cb_(index, val);
 }
 
-BYTE CPUState::get_ca() {
-    return reg_ca_;
+void CPUState::plain_o(void *ctx, int val) {
+    ((CPUState *)ctx)->plain_o_cb_(val);
 }
 
-void CPUState::set_ca(BYTE val) {
-    reg_ca_ = SET1(val);
+int CPUState::plain_k(void *ctx, int o_reg) {
+    return ((CPUState *)ctx)->plain_k_cb_(o_reg);
 }
 
-BYTE CPUState::get_cb() {
-    return reg_cb_;
+void CPUState::plain_batch(void *ctx, const OutputEvent *events, int count) {
+    ((CPUState *)ctx)->plain_batch_cb_(events, count);
 }
 
-void CPUState::set_cb(BYTE val) {
-    reg_cb_ = SET1(val);
+void CPUState::set_output_r_cb(void(*output_r_cb)(int, bool)) {
+    plain_r_cb_ = output_r_cb;
+    set_output_r_cb(output_r_cb ? plain_r : NULL, this);
 }
 
-BYTE CPUState::get_cs() {
-    return reg_cs_;
+void CPUState::set_output_o_cb(void(*output_o_cb)(int)) {
+    plain_o_cb_ = output_o_cb;
+    set_output_o_cb(output_o_cb ? plain_o : NULL, this);
 }
 
-void CPUState::set_cs(BYTE val) {
-    reg_cs_ = SET1(val);
+void CPUState::set_input_k_cb(int(*input_k_cb)(int)) {
+    plain_k_cb_ = input_k_cb;
+    set_input_k_cb(input_k_cb ? plain_k : NULL, this);
 }
 
-void CPUState::set_output_r_cb(void(*output_r_cb)(int, bool)) {
+void CPUState::set_output_r_cb(void(*output_r_cb)(void *, int, bool), void *ctx) {
     output_r_cb_ = output_r_cb;
+    output_r_ctx_ = ctx;
 }
 
-void CPUState::set_output_o_cb(void(*output_o_cb)(int)) {
+void CPUState::set_output_o_cb(void(*output_o_cb)(void *, int), void *ctx) {
     output_o_cb_ = output_o_cb;
+    output_o_ctx_ = ctx;
 }
 
-void CPUState::set_input_k_cb(int(*input_k_cb)(int)) {
+void CPUState::set_input_k_cb(int(*input_k_cb)(void *, int), void *ctx) {
     input_k_cb_ = input_k_cb;
+    input_k_ctx_ = ctx;
+}
+
+void CPUState::set_output_batch_cb(void(*output_batch_cb)(const OutputEvent *, int)) {
+    plain_batch_cb_ = output_batch_cb;
+    set_output_batch_cb(output_batch_cb ? plain_batch : NULL, this);
+}
+
+void CPUState::set_output_batch_cb(void(*output_batch_cb)(void *, const OutputEvent *, int), void *ctx) {
+    flush_output();
+    output_batch_cb_ = output_batch_cb;
+    output_batch_ctx_ = ctx;
+    if (output_batch_cb_ && !events_) {
+        events_ = new OutputEvent[OUTPUT_BUFFER_SIZE];
+    }
+}
+
+void CPUState::set_output_ring(OutputRing *output_ring) {
+    output_ring_ = output_ring;
+}
+
+void CPUState::set_output_change_only(bool change_only) {
+    change_only_ = change_only;
+}
+
+void CPUState::set_output_muted(bool muted) {
+    muted_ = muted;
+}
+
+void CPUState::save(MachineState &state) {
+    state.cycle = cycle_;
+    state.r = reg_r_;
+    state.a = reg_.a;
+    state.x = reg_.x;
+    state.y = reg_.y;
+    state.pa = reg_.pa;
+    state.pb = reg_.pb;
+    state.pc = reg_.pc;
+    state.sr = reg_.sr;
+    state.ca = reg_.ca;
+    state.cb = reg_.cb;
+    state.cs = reg_.cs;
+    state.cl = reg_.cl;
+    state.s = reg_.s;
+    state.sl = reg_.sl;
+    state.k = reg_.k;
+    state.o = reg_.o;
+    memcpy(state.ram, ram_, sizeof state.ram);
+    memset(state.reserved, 0, sizeof state.reserved);
+}
+
+void CPUState::load(const MachineState &state) {
+    cycle_ = state.cycle;
+    last_key_cycle_ = state.cycle;
+    set_a(state.a);
+    set_x(state.x);
+    set_y(state.y);
+    set_pa(state.pa);
+    set_pb(state.pb);
+    set_pc(state.pc);
+    set_sr(state.sr);
+    set_ca(state.ca);
+    set_cb(state.cb);
+    set_cs(state.cs);
+    set_cl(state.cl);
+    set_s(state.s);
+    set_sl(state.sl);
+    set_k(state.k);
+    memcpy(ram_, state.ram, sizeof ram_);
+
+    // report the whole latch even in change-only mode, the host's copy
+    // belongs to the state being replaced
+    reg_r_ = state.r & ((1 << R_WIDTH) - 1);
+    for (int i = 0; i < R_WIDTH; i++) {
+        output(OUTPUT_R, i, (reg_r_ >> i) & 1);
+    }
+    reg_.o = state.o;
+    output(OUTPUT_O, 0, reg_.o);
+}
+
+static_assert(sizeof(MachineState) == 96, "MachineState has padding holes");
+static_assert(sizeof(Registers) == 15, "Registers has padding holes");
+
+void check_state_file(const StateFile &file) {
+    if (memcmp(file.magic, STATE_MAGIC, sizeof file.magic) != 0) {
+        throw runtime_error("not a save state");
+    }
+    if (file.version != STATE_VERSION || file.size != sizeof(MachineState)) {
+        throw runtime_error("unsupported save state version: " + to_string(file.version));
+    }
+}
+
+void write_state_file(std::string filename, const MachineState &state) {
+    StateFile file;
+    memcpy(file.magic, STATE_MAGIC, sizeof file.magic);
+    file.version = STATE_VERSION;
+    file.size = sizeof(MachineState);
+    file.state = state;
+
+    ofstream ofd(filename, ios::binary | ios::out | ios::trunc);
+    if (!ofd.is_open()) {
+        throw runtime_error("error opening file: " + filename);
+    }
+    ofd.write((const char *)&file, sizeof file);
+    if (!ofd) {
+        throw runtime_error("error writing file: " + filename);
+    }
+}
+
+void read_state_file(std::string filename, MachineState &state) {
+    ifstream ifd(filename, ios::binary | ios::in);
+    if (!ifd.is_open()) {
+        throw runtime_error("error opening file: " + filename);
+    }
+    StateFile file;
+    ifd.read((char *)&file, sizeof file);
+    if (ifd.gcount() != sizeof file) {
+        throw runtime_error("truncated save state: " + filename);
+    }
+    check_state_file(file);
+    state = file.state;
 }
 
 
 // register to register
 void TMS1100::op_tay(BYTE, bool) {
     DEBUG_FUNCTION;
-    cpu_->set_y(cpu_->get_a());
+    cpu_.set_y(cpu_.get_a());
 }
 
 void TMS1100::op_tya(BYTE, bool) {
     DEBUG_FUNCTION;
-    cpu_->set_a(cpu_->get_y());
+    cpu_.set_a(cpu_.get_y());
 }
 
 void TMS1100::op_cla(BYTE, bool) {
     DEBUG_FUNCTION;
-    cpu_->set_a(0);
+    cpu_.set_a(0);
 }
 
 // transfer register to memory
 void TMS1100::op_tam(BYTE, bool) {
     DEBUG_FUNCTION;
-    CURR_RAM = cpu_->get_a();
+    cpu_.set_ram(cpu_.get_a());
 }
 
 void TMS1100::op_tamiyc(BYTE, bool) {
     DEBUG_FUNCTION;
-    CURR_RAM = cpu_->get_a();
-    cpu_->set_s(cpu_->get_y() == 0x0F);
-    cpu_->inc_y();
+    cpu_.set_ram(cpu_.get_a());
+    cpu_.set_s(cpu_.get_y() == 0x0F);
+    cpu_.inc_y();
 }
 
 void TMS1100::op_tamdyn(BYTE, bool) {
     DEBUG_FUNCTION;
-    CURR_RAM = cpu_->get_a();
-    cpu_->set_s(cpu_->get_y() >= 1);
-    cpu_->dec_y();
+    cpu_.set_ram(cpu_.get_a());
+    cpu_.set_s(cpu_.get_y() >= 1);
+    cpu_.dec_y();
 }
 
 void TMS1100::op_tamza(BYTE, bool) {
     DEBUG_FUNCTION;
-    CURR_RAM = cpu_->get_a();
-    cpu_->set_a(0);
+    cpu_.set_ram(cpu_.get_a());
+    cpu_.set_a(0);
 }
 
 // memory to register
 void TMS1100::op_tmy(BYTE, bool) {
     DEBUG_FUNCTION;
-    cpu_->set_y(CURR_RAM);
+    cpu_.set_y(CURR_RAM);
 }
 
 void TMS1100::op_tma(BYTE, bool) {
     DEBUG_FUNCTION;
-    cpu_->set_a(CURR_RAM);
+    cpu_.set_a(CURR_RAM);
 }
 
 void TMS1100::op_xma(BYTE, bool) {
     DEBUG_FUNCTION;
     BYTE temp = CURR_RAM;
-    CURR_RAM = cpu_->get_a();
-    cpu_->set_a(temp);
+    cpu_.set_ram(cpu_.get_a());
+    cpu_.set_a(temp);
 }
 
 void TMS1100::uADC_a(BYTE val) {
     DEBUG_FUNCTION;
-    BYTE sum = cpu_->get_a() + val;
-    cpu_->set_s(sum > 0x0F);
-    cpu_->set_a(sum);
+    BYTE sum = cpu_.get_a() + val;
+    cpu_.set_s(sum > 0x0F);
+    cpu_.set_a(sum);
 }
 
 void TMS1100::uADC_y(BYTE val) {
     DEBUG_FUNCTION;
-    BYTE sum = cpu_->get_y() + val;
-    cpu_->set_s(sum > 0x0F);
-    cpu_->set_y(sum);
+    BYTE sum = cpu_.get_y() + val;
+    cpu_.set_s(sum > 0x0F);
+    cpu_.set_y(sum);
 }
 
 // arithmetic
@@ -376,26 +982,26 @@ void TMS1100::op_amaac(BYTE, bool) {
 
 void TMS1100::op_saman(BYTE, bool) {
     DEBUG_FUNCTION;
-    BYTE sum = NOT4(cpu_->get_a()) + CURR_RAM + 1;
-    cpu_->set_s(sum > 0x0F);
-    cpu_->set_a(sum);
+    BYTE sum = NOT4(cpu_.get_a()) + CURR_RAM + 1;
+    cpu_.set_s(sum > 0x0F);
+    cpu_.set_a(sum);
 }
 
 void TMS1100::op_imac(BYTE, bool) {
     DEBUG_FUNCTION;
-    cpu_->set_a(CURR_RAM);
+    cpu_.set_a(CURR_RAM);
     uADC_a(0x01);
 }
 
 void TMS1100::op_dman(BYTE, bool) {
     DEBUG_FUNCTION;
-    cpu_->set_a(CURR_RAM);
+    cpu_.set_a(CURR_RAM);
     uADC_a(0x0F);
 }
 
-void TMS1100::op_a_aac(BYTE opcode, bool) {
+void TMS1100::op_a_aac(BYTE arg, bool) {
     DEBUG_FUNCTION;
-    uADC_a(op_code_constant_[opcode]);
+    uADC_a(arg);
 }
 
 void TMS1100::op_iyc(BYTE, bool) {
@@ -410,329 +1016,694 @@ void TMS1100::op_dyn(BYTE, bool) {
 
 void TMS1100::op_cpaiz(BYTE, bool) {
     DEBUG_FUNCTION;
-    BYTE sum = NOT4(cpu_->get_a()) + 1;
-    cpu_->set_s(sum > 0x0F);
-    cpu_->set_a(sum);
+    BYTE sum = NOT4(cpu_.get_a()) + 1;
+    cpu_.set_s(sum > 0x0F);
+    cpu_.set_a(sum);
 }
 
 // arithmetic compare
 void TMS1100::op_alem(BYTE, bool) {
     DEBUG_FUNCTION;
-    BYTE sum = NOT4(cpu_->get_a()) + CURR_RAM + 1;
-    cpu_->set_s(sum > 0x0F);
+    BYTE sum = NOT4(cpu_.get_a()) + CURR_RAM + 1;
+    cpu_.set_s(sum > 0x0F);
 }
 
 // logical compare
-void TMS1100::op_mnea(BYTE opcode, bool) {
+void TMS1100::op_mnea(BYTE, bool) {
     DEBUG_FUNCTION;
-    cpu_->set_s(CURR_RAM != cpu_->get_a());
+    cpu_.set_s(CURR_RAM != cpu_.get_a());
 }
 
 void TMS1100::op_mnez(BYTE, bool) {
     DEBUG_FUNCTION;
-    cpu_->set_s(CURR_RAM != 0);
+    cpu_.set_s(CURR_RAM != 0);
 }
 
 void TMS1100::op_ynea(BYTE, bool) {
     DEBUG_FUNCTION;
-    cpu_->set_s(cpu_->get_a() != cpu_->get_y());
-    cpu_->set_sl(cpu_->get_s());
+    cpu_.set_s(cpu_.get_a() != cpu_.get_y());
+    cpu_.set_sl(cpu_.get_s());
 }
 
-void TMS1100::op_ldp(BYTE opcode, bool) {
+void TMS1100::op_ldp(BYTE arg, bool) {
     DEBUG_FUNCTION;
-    cpu_->set_pb(op_code_constant_[opcode]);
+    cpu_.set_pb(arg);
 }
 
-void TMS1100::op_tcy(BYTE opcode, bool) {
+void TMS1100::op_tcy(BYTE arg, bool) {
     DEBUG_FUNCTION;
-    cpu_->set_y(op_code_constant_[opcode]);
+    cpu_.set_y(arg);
 }
 
-void TMS1100::op_ynec(BYTE opcode, bool) {
+void TMS1100::op_ynec(BYTE arg, bool) {
     DEBUG_FUNCTION;
-    cpu_->set_s(cpu_->get_y() != op_code_constant_[opcode]);
+    cpu_.set_s(cpu_.get_y() != arg);
 }
 
-void TMS1100::op_tcmiy(BYTE opcode, bool) {
+void TMS1100::op_tcmiy(BYTE arg, bool) {
     DEBUG_FUNCTION;
-    CURR_RAM = op_code_constant_[opcode];
-    cpu_->inc_y();
+    cpu_.set_ram(arg);
+    cpu_.inc_y();
 }
 
 // bits in memory
 void TMS1100::op_comx(BYTE, bool) {
     DEBUG_FUNCTION;
-    cpu_->com_x();
+    cpu_.com_x();
 }
 
 void TMS1100::op_comc(BYTE, bool) {
     DEBUG_FUNCTION;
-    cpu_->com_cb();
+    cpu_.com_cb();
 }
 
-void TMS1100::op_sbit(BYTE opcode, bool) {
+void TMS1100::op_sbit(BYTE arg, bool) {
     DEBUG_FUNCTION;
-    BYTE setBit = 1 << op_code_constant_[opcode];
-    CURR_RAM |= setBit;
+    BYTE setBit = 1 << arg;
+    cpu_.set_ram(CURR_RAM | setBit);
 }
 
-void TMS1100::op_rbit(BYTE opcode, bool) {
+void TMS1100::op_rbit(BYTE arg, bool) {
     DEBUG_FUNCTION;
-    BYTE setBit = SET4(~(1 << op_code_constant_[opcode]));
-    CURR_RAM &= setBit;
+    BYTE setBit = SET4(~(1 << arg));
+    cpu_.set_ram(CURR_RAM & setBit);
 }
 
-void TMS1100::op_tbit1(BYTE opcode, bool) {
+void TMS1100::op_tbit1(BYTE arg, bool) {
     DEBUG_FUNCTION;
-    cpu_->set_s(CURR_RAM & (1 << op_code_constant_[opcode]));
+    cpu_.set_s(CURR_RAM & (1 << arg));
 }
 
 // input
 void TMS1100::op_knez(BYTE, bool) {
     DEBUG_FUNCTION;
-	cpu_->set_s(cpu_->get_k() != 0);
+	cpu_.set_s(cpu_.get_k() != 0);
 }
 
 void TMS1100::op_tka(BYTE, bool) {
     DEBUG_FUNCTION;
-    cpu_->set_a(cpu_->get_k());
+    cpu_.set_a(cpu_.get_k());
 }
 
 // output
 void TMS1100::op_setr(BYTE, bool) {
     DEBUG_FUNCTION;
-    if (cpu_->get_x() <= 3 && cpu_->get_y() <= 10) {
-        cpu_->set_r_index(cpu_->get_y());
+    if (cpu_.get_x() <= 3 && cpu_.get_y() <= 10) {
+        cpu_.set_r_index(cpu_.get_y());
     }
 }
 
 void TMS1100::op_rstr(BYTE, bool) {
     DEBUG_FUNCTION;
-    if (cpu_->get_x() <= 3 && cpu_->get_y() <= 10) {
-        cpu_->rst_r_index(cpu_->get_y());
+    if (cpu_.get_x() <= 3 && cpu_.get_y() <= 10) {
+        cpu_.rst_r_index(cpu_.get_y());
     }
 }
 
 void TMS1100::op_tdo(BYTE, bool) {
     DEBUG_FUNCTION;
     // LSB <=> MSB Inverted relative to fuse map (SL = MSB)
-    cpu_->set_o(cpu_->get_a() | (cpu_->get_sl() ? 0x10 : 0));
+    cpu_.set_o(cpu_.get_a() | (cpu_.get_sl() ? 0x10 : 0));
 }
 
-void TMS1100::op_ldx(BYTE opcode, bool) {
+void TMS1100::op_ldx(BYTE arg, bool) {
     DEBUG_FUNCTION;
-    cpu_->set_x(op_code_constant_[opcode]);
+    cpu_.set_x(arg);
 }
 
 // rom addressing
-void TMS1100::op_br(BYTE opcode, bool last_s) {
+void TMS1100::op_br(BYTE arg, bool last_s) {
     DEBUG_FUNCTION;
     if (!last_s) {
         return;
     }
 
-    cpu_->set_ca(cpu_->get_cb());
-    cpu_->set_pc(SET6(opcode));
+    cpu_.set_ca(cpu_.get_cb());
+    cpu_.set_pc(arg);
         
-    if (!cpu_->get_cl()) {
-        cpu_->set_pa(cpu_->get_pb());
+    if (!cpu_.get_cl()) {
+        cpu_.set_pa(cpu_.get_pb());
     }
 }
 
-void TMS1100::op_call(BYTE opcode, bool last_s) {
+void TMS1100::op_call(BYTE arg, bool last_s) {
     DEBUG_FUNCTION;
     if (!last_s) {
         return;
     }
 
-    if (cpu_->get_cl()) {
-        cpu_->set_pb(cpu_->get_pa());
+    if (cpu_.get_cl()) {
+        cpu_.set_pb(cpu_.get_pa());
     }
     else {
-        cpu_->set_cs(cpu_->get_ca());
-        cpu_->set_sr(cpu_->get_pc());
+        cpu_.set_cs(cpu_.get_ca());
+        cpu_.set_sr(cpu_.get_pc());
 
         // PB <=> PA
-        BYTE temp = cpu_->get_pb();
-        cpu_->set_pb(cpu_->get_pa());
-        cpu_->set_pa(temp);
+        BYTE temp = cpu_.get_pb();
+        cpu_.set_pb(cpu_.get_pa());
+        cpu_.set_pa(temp);
 
-        cpu_->set_cl(true);
+        cpu_.set_cl(true);
     }
-    cpu_->set_ca(cpu_->get_cb());
-    cpu_->set_pc(SET6(opcode));
+    cpu_.set_ca(cpu_.get_cb());
+    cpu_.set_pc(arg);
 }
 
 void TMS1100::op_retn(BYTE, bool) {
     DEBUG_FUNCTION;
-    cpu_->set_pa(cpu_->get_pb());
-    if (cpu_->get_cl()) {
-        cpu_->set_ca(cpu_->get_cs());
-        cpu_->set_pc(cpu_->get_sr());
-        cpu_->set_cl(false);
+    cpu_.set_pa(cpu_.get_pb());
+    if (cpu_.get_cl()) {
+        cpu_.set_ca(cpu_.get_cs());
+        cpu_.set_pc(cpu_.get_sr());
+        cpu_.set_cl(false);
     }
 }
 
-// TMS1100::TMS1100(void(*output_r_cb)(int, bool),void(*output_o_cb)(int)) {
-//     cpu_ = CPUState(output_r_cb, output_o_cb);
-//     for (int i = 0; i <= 255; i++) {
-//         op_code_func_[i] = NULL;
-//     }
-//     setup_op_codes();
-// }
+// fused superinstructions, see translate_rom()
+void TMS1100::op_ldx_tcy(BYTE arg, bool) {
+    DEBUG_FUNCTION;
+    cpu_.set_x(arg >> 4);
+    cpu_.set_y(arg);
+}
 
-void TMS1100::setup_op_codes() {
-    op_code_func_[0x20] = &TMS1100::op_tay;
-    op_code_func_[0x23] = &TMS1100::op_tya;
-    op_code_func_[0x7f] = &TMS1100::op_cla;
+void TMS1100::op_ldx_tcy_tma(BYTE arg, bool) {
+    DEBUG_FUNCTION;
+    cpu_.set_x(arg >> 4);
+    cpu_.set_y(arg);
+    cpu_.set_a(CURR_RAM);
+}
 
-    // transfer register to memory
-    op_code_func_[0x27] = &TMS1100::op_tam;
-    op_code_func_[0x25] = &TMS1100::op_tamiyc;
-    op_code_func_[0x24] = &TMS1100::op_tamdyn;
-    op_code_func_[0x26] = &TMS1100::op_tamza;
+void TMS1100::op_tcy_tma(BYTE arg, bool) {
+    DEBUG_FUNCTION;
+    cpu_.set_y(arg);
+    cpu_.set_a(CURR_RAM);
+}
 
-    // memory to register
-    op_code_func_[0x22] = &TMS1100::op_tmy;
-    op_code_func_[0x21] = &TMS1100::op_tma;
-    op_code_func_[0x03] = &TMS1100::op_xma;
+void TMS1100::op_tcy_tcmiy(BYTE arg, bool) {
+    DEBUG_FUNCTION;
+    // the TCMIY constants are read from the words following the TCY
+    WORD page = (cpu_.get_ca() << 10) | (cpu_.get_pa() << 6);
+    BYTE pc = cpu_.get_pc();
+    cpu_.set_y(arg);
+    for (int i = 0; i < arg >> 4; i++) {
+        cpu_.set_ram(rom_->get_instruction(page | SET6(pc + i)).arg);
+        cpu_.inc_y();
+    }
+}
 
-    // arithmetic
-    op_code_func_[0x06] = &TMS1100::op_amaac;
-    op_code_func_[0x3c] = &TMS1100::op_saman;
-    op_code_func_[0x3e] = &TMS1100::op_imac;
+void TMS1100::op_xma_dyn(BYTE, bool) {
+    DEBUG_FUNCTION;
+    op_xma(0, true);
+    op_dyn(0, true);
+}
 
-    op_code_func_[0x07] = &TMS1100::op_dman;
+const TMS1100::OpTable TMS1100::op_table_;
 
-    // ia, a9aac, a5aac, a13aac, a3aac, a11aac, a7aac, dan, a2aac, a10aac, a6aac
-    // a14aac, a4aac, a12aac, a8aac
-    BYTE op_constants_0[] = {1, 9, 5, 13, 3, 11, 7, 15, 2, 10, 6, 14, 4, 12, 8};
-    for (BYTE i = 0; i < sizeof(op_constants_0)/sizeof op_constants_0[0]; i++) {
-        BYTE op_index = 0x70 + i;
-        op_code_func_[op_index] = &TMS1100::op_a_aac;
-        op_code_constant_[op_index] = op_constants_0[i];
-    }
+TMS1100::OpTable::OpTable() {
+    func[OP_INVALID] = NULL;
+
+    // register to register
+    func[OP_TAY] = &TMS1100::op_tay;
+    func[OP_TYA] = &TMS1100::op_tya;
+    func[OP_CLA] = &TMS1100::op_cla;
 
-    op_code_func_[0x05] = &TMS1100::op_iyc;
-    op_code_func_[0x04] = &TMS1100::op_dyn;
-    op_code_func_[0x3d] = &TMS1100::op_cpaiz;
+    // transfer register to memory
+    func[OP_TAM] = &TMS1100::op_tam;
+    func[OP_TAMIYC] = &TMS1100::op_tamiyc;
+    func[OP_TAMDYN] = &TMS1100::op_tamdyn;
+    func[OP_TAMZA] = &TMS1100::op_tamza;
+
+    // memory to register
+    func[OP_TMY] = &TMS1100::op_tmy;
+    func[OP_TMA] = &TMS1100::op_tma;
+    func[OP_XMA] = &TMS1100::op_xma;
+
+    // arithmetic
+    func[OP_AMAAC] = &TMS1100::op_amaac;
+    func[OP_SAMAN] = &TMS1100::op_saman;
+    func[OP_IMAC] = &TMS1100::op_imac;
+    func[OP_DMAN] = &TMS1100::op_dman;
+    func[OP_A_AAC] = &TMS1100::op_a_aac;
+    func[OP_IYC] = &TMS1100::op_iyc;
+    func[OP_DYN] = &TMS1100::op_dyn;
+    func[OP_CPAIZ] = &TMS1100::op_cpaiz;
 
     // arithmetic compare
-    op_code_func_[0x01] = &TMS1100::op_alem;
+    func[OP_ALEM] = &TMS1100::op_alem;
 
     // logical compare
-    op_code_func_[0x00] = &TMS1100::op_mnea;
-    op_code_func_[0x3f] = &TMS1100::op_mnez;
-    op_code_func_[0x02] = &TMS1100::op_ynea;
+    func[OP_MNEA] = &TMS1100::op_mnea;
+    func[OP_MNEZ] = &TMS1100::op_mnez;
+    func[OP_YNEA] = &TMS1100::op_ynea;
 
-    BYTE op_constants_1[] = {0, 8, 4, 12, 2, 10, 6, 14, 1, 9, 5, 13, 3, 11, 7, 15};
-    for (BYTE i = 0; i < sizeof(op_constants_1)/sizeof op_constants_1[0]; i++) {
-        BYTE op_index = 0x10 + i;
-        op_code_func_[op_index] = &TMS1100::op_ldp;
-        op_code_constant_[op_index] = op_constants_1[i];
-        op_index = 0x40 + i;
-        op_code_func_[op_index] = &TMS1100::op_tcy;
-        op_code_constant_[op_index] = op_constants_1[i];
-        op_index = 0x50 + i;
-        op_code_func_[op_index] = &TMS1100::op_ynec;
-        op_code_constant_[op_index] = op_constants_1[i];
-        op_index = 0x60 + i;
-        op_code_func_[op_index] = &TMS1100::op_tcmiy;
-        op_code_constant_[op_index] = op_constants_1[i];
-    }
+    func[OP_LDP] = &TMS1100::op_ldp;
+    func[OP_TCY] = &TMS1100::op_tcy;
+    func[OP_YNEC] = &TMS1100::op_ynec;
+    func[OP_TCMIY] = &TMS1100::op_tcmiy;
 
     // bits in memory
-    op_code_func_[0x09] = &TMS1100::op_comx;
-    op_code_func_[0x0b] = &TMS1100::op_comc;
-
-    BYTE op_constants_2[] = {0, 2, 1, 3};
-    for (BYTE i = 0; i < sizeof(op_constants_2)/sizeof op_constants_2[0]; i++) {
-        BYTE op_index = 0x30 + i;
-        op_code_func_[op_index] = &TMS1100::op_sbit;
-        op_code_constant_[op_index] = op_constants_2[i];
-        op_index = 0x34 + i;
-        op_code_func_[op_index] = &TMS1100::op_rbit;
-        op_code_constant_[op_index] = op_constants_2[i];
-        op_index = 0x38 + i;
-        op_code_func_[op_index] = &TMS1100::op_tbit1;
-        op_code_constant_[op_index] = op_constants_2[i];
-    }
+    func[OP_COMX] = &TMS1100::op_comx;
+    func[OP_COMC] = &TMS1100::op_comc;
+    func[OP_SBIT] = &TMS1100::op_sbit;
+    func[OP_RBIT] = &TMS1100::op_rbit;
+    func[OP_TBIT1] = &TMS1100::op_tbit1;
 
     // input
-    op_code_func_[0x0e] = &TMS1100::op_knez;
-    op_code_func_[0x08] = &TMS1100::op_tka;
+    func[OP_KNEZ] = &TMS1100::op_knez;
+    func[OP_TKA] = &TMS1100::op_tka;
 
     // output
-    op_code_func_[0x0d] = &TMS1100::op_setr;
-    op_code_func_[0x0c] = &TMS1100::op_rstr;
-    op_code_func_[0x0a] = &TMS1100::op_tdo;
+    func[OP_SETR] = &TMS1100::op_setr;
+    func[OP_RSTR] = &TMS1100::op_rstr;
+    func[OP_TDO] = &TMS1100::op_tdo;
 
     // ram 'x' addressing
-    BYTE op_constants_3[] = {0, 4, 2, 6, 1, 5, 3, 7};
-    for (BYTE i = 0; i < sizeof(op_constants_3)/sizeof op_constants_3[0]; i++) {
-        BYTE op_index = 0x28 + i;
-        op_code_func_[op_index] = &TMS1100::op_ldx;
-        op_code_constant_[op_index] = op_constants_3[i];
-    }
+    func[OP_LDX] = &TMS1100::op_ldx;
 
-    // addressing
-    for (BYTE i = 0; i < 0x40; i++) {
-        op_code_func_[0x80 + i] = &TMS1100::op_br;
-        op_code_func_[0xC0 + i] = &TMS1100::op_call;
-    }
+    // rom addressing
+    func[OP_BR] = &TMS1100::op_br;
+    func[OP_CALL] = &TMS1100::op_call;
+    func[OP_RETN] = &TMS1100::op_retn;
 
-    op_code_func_[0x0f] = &TMS1100::op_retn;
+    // fused superinstructions
+    func[OP_LDX_TCY] = &TMS1100::op_ldx_tcy;
+    func[OP_LDX_TCY_TMA] = &TMS1100::op_ldx_tcy_tma;
+    func[OP_TCY_TMA] = &TMS1100::op_tcy_tma;
+    func[OP_TCY_TCMIY] = &TMS1100::op_tcy_tcmiy;
+    func[OP_XMA_DYN] = &TMS1100::op_xma_dyn;
 }
 
 void TMS1100::set_output_r_cb(void(*output_r_cb)(int, bool)) {
-    cpu_->set_output_r_cb(output_r_cb);
+    cpu_.set_output_r_cb(output_r_cb);
 }
 
 void TMS1100::set_output_o_cb(void(*output_o_cb)(int)) {
-    cpu_->set_output_o_cb(output_o_cb);
+    cpu_.set_output_o_cb(output_o_cb);
 }
 
 void TMS1100::set_input_k_cb(int(*input_k_cb)(int)) {
-    cpu_->set_input_k_cb(input_k_cb);
+    cpu_.set_input_k_cb(input_k_cb);
+}
+
+void TMS1100::set_output_batch_cb(void(*output_batch_cb)(const OutputEvent *, int)) {
+    cpu_.set_output_batch_cb(output_batch_cb);
+}
+
+void TMS1100::set_output_r_cb(void(*output_r_cb)(void *, int, bool), void *ctx) {
+    cpu_.set_output_r_cb(output_r_cb, ctx);
+}
+
+void TMS1100::set_output_o_cb(void(*output_o_cb)(void *, int), void *ctx) {
+    cpu_.set_output_o_cb(output_o_cb, ctx);
+}
+
+void TMS1100::set_input_k_cb(int(*input_k_cb)(void *, int), void *ctx) {
+    cpu_.set_input_k_cb(input_k_cb, ctx);
+}
+
+void TMS1100::set_io(const IOPorts &ports) {
+    cpu_.set_output_r_cb(ports.output_r, ports.ctx);
+    cpu_.set_output_o_cb(ports.output_o, ports.ctx);
+    cpu_.set_input_k_cb(ports.input_k, ports.ctx);
+}
+
+void TMS1100::set_output_batch_cb(void(*output_batch_cb)(void *, const OutputEvent *, int), void *ctx) {
+    cpu_.set_output_batch_cb(output_batch_cb, ctx);
+}
+
+void TMS1100::flush_output() {
+    cpu_.flush_output();
+}
+
+void TMS1100::set_output_ring(OutputRing *output_ring) {
+    cpu_.set_output_ring(output_ring);
+}
+
+void TMS1100::set_output_change_only(bool change_only) {
+    cpu_.set_output_change_only(change_only);
+}
+
+void TMS1100::set_output_muted(bool muted) {
+    cpu_.set_output_muted(muted);
+}
+
+const Registers *TMS1100::get_registers() {
+    return cpu_.get_registers();
+}
+
+const WORD *TMS1100::get_r_latch() {
+    return cpu_.get_r_latch();
+}
+
+const BYTE *TMS1100::get_ram_data() {
+    return cpu_.get_ram_data();
+}
+
+void TMS1100::save_state(MachineState &state) {
+    cpu_.save(state);
+}
+
+void TMS1100::load_state(const MachineState &state) {
+    stop_requested_.store(false, memory_order_relaxed);
+    cpu_.load(state);
+}
+
+void TMS1100::save_state(std::string filename) {
+    MachineState state;
+    save_state(state);
+    write_state_file(filename, state);
+}
+
+void TMS1100::load_state(std::string filename) {
+    MachineState state;
+    read_state_file(filename, state);
+    load_state(state);
 }
 
-void TMS1100::exec(BYTE opcode) {
-    bool last_status = cpu_->get_s();
-    cpu_->set_s(true);
-    void(TMS1100::*func)(BYTE, bool) = op_code_func_[opcode];
+/*
+ * Two interchangeable dispatchers for step():
+ *   default                  indirect call through op_table_
+ *   TMS1100_SWITCH_DISPATCH  switch over the handler id, which lets the compiler
+ *                            inline every handler into exec()
+ * run() doesn't use either, it runs whole blocks in run_block().
+ */
+#ifndef TMS1100_SWITCH_DISPATCH
+void TMS1100::exec(const Instruction &ins) {
+    bool last_status = cpu_.get_s();
+    cpu_.set_s(true);
+    void(TMS1100::*func)(BYTE, bool) = op_table_.func[ins.op];
     if (func) {
-        (this->*func)(opcode, last_status);
+        (this->*func)(ins.arg, last_status);
+    }
+}
+#else
+void TMS1100::exec(const Instruction &ins) {
+    bool last_status = cpu_.get_s();
+    cpu_.set_s(true);
+    switch (ins.op) {
+        // register to register
+        case OP_TAY: op_tay(ins.arg, last_status); break;
+        case OP_TYA: op_tya(ins.arg, last_status); break;
+        case OP_CLA: op_cla(ins.arg, last_status); break;
+
+        // transfer register to memory
+        case OP_TAM: op_tam(ins.arg, last_status); break;
+        case OP_TAMIYC: op_tamiyc(ins.arg, last_status); break;
+        case OP_TAMDYN: op_tamdyn(ins.arg, last_status); break;
+        case OP_TAMZA: op_tamza(ins.arg, last_status); break;
+
+        // memory to register
+        case OP_TMY: op_tmy(ins.arg, last_status); break;
+        case OP_TMA: op_tma(ins.arg, last_status); break;
+        case OP_XMA: op_xma(ins.arg, last_status); break;
+
+        // arithmetic
+        case OP_AMAAC: op_amaac(ins.arg, last_status); break;
+        case OP_SAMAN: op_saman(ins.arg, last_status); break;
+        case OP_IMAC: op_imac(ins.arg, last_status); break;
+        case OP_DMAN: op_dman(ins.arg, last_status); break;
+        case OP_A_AAC: op_a_aac(ins.arg, last_status); break;
+        case OP_IYC: op_iyc(ins.arg, last_status); break;
+        case OP_DYN: op_dyn(ins.arg, last_status); break;
+        case OP_CPAIZ: op_cpaiz(ins.arg, last_status); break;
+
+        // arithmetic compare
+        case OP_ALEM: op_alem(ins.arg, last_status); break;
+
+        // logical compare
+        case OP_MNEA: op_mnea(ins.arg, last_status); break;
+        case OP_MNEZ: op_mnez(ins.arg, last_status); break;
+        case OP_YNEA: op_ynea(ins.arg, last_status); break;
+
+        case OP_LDP: op_ldp(ins.arg, last_status); break;
+        case OP_TCY: op_tcy(ins.arg, last_status); break;
+        case OP_YNEC: op_ynec(ins.arg, last_status); break;
+        case OP_TCMIY: op_tcmiy(ins.arg, last_status); break;
+
+        // bits in memory
+        case OP_COMX: op_comx(ins.arg, last_status); break;
+        case OP_COMC: op_comc(ins.arg, last_status); break;
+        case OP_SBIT: op_sbit(ins.arg, last_status); break;
+        case OP_RBIT: op_rbit(ins.arg, last_status); break;
+        case OP_TBIT1: op_tbit1(ins.arg, last_status); break;
+
+        // input
+        case OP_KNEZ: op_knez(ins.arg, last_status); break;
+        case OP_TKA: op_tka(ins.arg, last_status); break;
+
+        // output
+        case OP_SETR: op_setr(ins.arg, last_status); break;
+        case OP_RSTR: op_rstr(ins.arg, last_status); break;
+        case OP_TDO: op_tdo(ins.arg, last_status); break;
+
+        // ram 'x' addressing
+        case OP_LDX: op_ldx(ins.arg, last_status); break;
+
+        // rom addressing
+        case OP_BR: op_br(ins.arg, last_status); break;
+        case OP_CALL: op_call(ins.arg, last_status); break;
+        case OP_RETN: op_retn(ins.arg, last_status); break;
+
+        // fused superinstructions
+        case OP_LDX_TCY: op_ldx_tcy(ins.arg, last_status); break;
+        case OP_LDX_TCY_TMA: op_ldx_tcy_tma(ins.arg, last_status); break;
+        case OP_TCY_TMA: op_tcy_tma(ins.arg, last_status); break;
+        case OP_TCY_TCMIY: op_tcy_tcmiy(ins.arg, last_status); break;
+        case OP_XMA_DYN: op_xma_dyn(ins.arg, last_status); break;
     }
 }
+#endif
 
 void TMS1100::step() {
-    WORD rom_address = (cpu_->get_ca() << 10) | (cpu_->get_pa() << 6) | cpu_->get_pc();
-    BYTE opcode = rom_->get_data(rom_address);
+    WORD rom_address = (cpu_.get_ca() << 10) | (cpu_.get_pa() << 6) | cpu_.get_pc();
+    const Instruction &ins = rom_->get_instruction(rom_address);
 
     // useful for debugging
     // printf("%1x:%02x %02x x:%02x y:%02x a:%02x s:%1x ram:%02x cl:%02x ca:%02x cb:%02x\n",
-    //     cpu_->get_pa(), cpu_->get_pc(), opcode, cpu_->get_x(), cpu_->get_y(), cpu_->get_a(),
-    //     cpu_->get_s(), CURR_RAM, cpu_->get_cl(), cpu_->get_ca(), cpu_->get_cb());
+    //     cpu_.get_pa(), cpu_.get_pc(), rom_->get_data(rom_address), cpu_.get_x(), cpu_.get_y(), cpu_.get_a(),
+    //     cpu_.get_s(), CURR_RAM, cpu_.get_cl(), cpu_.get_ca(), cpu_.get_cb());
 
-    cpu_->increment_pc();
-    exec(opcode);
+    cpu_.increment_pc();
+    exec(ins);
+    cpu_.add_cycles(1);
 };
 
-TMS1100::TMS1100(ROM *rom) {
-    cpu_ = new CPUState();
-    for (int i = 0; i <= 255; i++) {
-        op_code_func_[i] = NULL;
+/*
+ * Execute the translated basic block at 'index' as one unit, returns the
+ * number of ROM words executed.
+ *
+ * Blocks are run as threaded code (one computed goto per handler), and the
+ * next address is derived from the current one rather than from the length
+ * of the word just loaded, which keeps the fetch of the next word off the
+ * critical path. Both matter: a switch in a loop is slower than step().
+ */
+int TMS1100::run_block(WORD index) {
+    static void *handlers[] = {
+        &&l_invalid,
+        &&l_tay, &&l_tya, &&l_cla,
+        &&l_tam, &&l_tamiyc, &&l_tamdyn, &&l_tamza,
+        &&l_tmy, &&l_tma, &&l_xma,
+        &&l_amaac, &&l_saman, &&l_imac, &&l_dman, &&l_a_aac, &&l_iyc, &&l_dyn, &&l_cpaiz,
+        &&l_alem,
+        &&l_mnea, &&l_mnez, &&l_ynea,
+        &&l_ldp, &&l_tcy, &&l_ynec, &&l_tcmiy,
+        &&l_comx, &&l_comc, &&l_sbit, &&l_rbit, &&l_tbit1,
+        &&l_knez, &&l_tka,
+        &&l_setr, &&l_rstr, &&l_tdo,
+        &&l_ldx,
+        &&l_br, &&l_call, &&l_retn,
+        &&l_ldx_tcy, &&l_ldx_tcy_tma, &&l_tcy_tma, &&l_tcy_tcmiy, &&l_xma_dyn
+    };
+    static_assert(sizeof(handlers) / sizeof(handlers[0]) == OP_COUNT, "one handler per OpId");
+
+    const Instruction *ins = &rom_->get_block(index);
+    int block_len = ins->block_len;
+    int remaining = block_len;
+    bool last_status;
+    BYTE pc;
+
+// same as step() + exec() for the word at 'index'
+#define BLOCK_DISPATCH() \
+    pc = SET6(index + 1); \
+    cpu_.set_pc(pc); \
+    last_status = cpu_.get_s(); \
+    cpu_.set_s(true); \
+    goto *handlers[ins->op]
+
+// move past the 'len' words just executed, only pages without a
+// terminator run out of words
+#define BLOCK_NEXT(len) \
+    cpu_.add_cycles(len); \
+    remaining -= (len); \
+    index = (index & 0xFFC0) | SET6(index + (len)); \
+    if (remaining <= 0) { \
+        cpu_.set_pc(index); \
+        return block_len; \
+    } \
+    ins = &rom_->get_block(index); \
+    BLOCK_DISPATCH()
+
+    BLOCK_DISPATCH();
+
+l_invalid: BLOCK_NEXT(1);
+l_tay: op_tay(ins->arg, last_status); BLOCK_NEXT(1);
+l_tya: op_tya(ins->arg, last_status); BLOCK_NEXT(1);
+l_cla: op_cla(ins->arg, last_status); BLOCK_NEXT(1);
+l_tam: op_tam(ins->arg, last_status); BLOCK_NEXT(1);
+l_tamiyc: op_tamiyc(ins->arg, last_status); BLOCK_NEXT(1);
+l_tamdyn: op_tamdyn(ins->arg, last_status); BLOCK_NEXT(1);
+l_tamza: op_tamza(ins->arg, last_status); BLOCK_NEXT(1);
+l_tmy: op_tmy(ins->arg, last_status); BLOCK_NEXT(1);
+l_tma: op_tma(ins->arg, last_status); BLOCK_NEXT(1);
+l_xma: op_xma(ins->arg, last_status); BLOCK_NEXT(1);
+l_amaac: op_amaac(ins->arg, last_status); BLOCK_NEXT(1);
+l_saman: op_saman(ins->arg, last_status); BLOCK_NEXT(1);
+l_imac: op_imac(ins->arg, last_status); BLOCK_NEXT(1);
+l_dman: op_dman(ins->arg, last_status); BLOCK_NEXT(1);
+l_a_aac: op_a_aac(ins->arg, last_status); BLOCK_NEXT(1);
+l_iyc: op_iyc(ins->arg, last_status); BLOCK_NEXT(1);
+l_dyn: op_dyn(ins->arg, last_status); BLOCK_NEXT(1);
+l_cpaiz: op_cpaiz(ins->arg, last_status); BLOCK_NEXT(1);
+l_alem: op_alem(ins->arg, last_status); BLOCK_NEXT(1);
+l_mnea: op_mnea(ins->arg, last_status); BLOCK_NEXT(1);
+l_mnez: op_mnez(ins->arg, last_status); BLOCK_NEXT(1);
+l_ynea: op_ynea(ins->arg, last_status); BLOCK_NEXT(1);
+l_ldp: op_ldp(ins->arg, last_status); BLOCK_NEXT(1);
+l_tcy: op_tcy(ins->arg, last_status); BLOCK_NEXT(1);
+l_ynec: op_ynec(ins->arg, last_status); BLOCK_NEXT(1);
+l_tcmiy: op_tcmiy(ins->arg, last_status); BLOCK_NEXT(1);
+l_comx: op_comx(ins->arg, last_status); BLOCK_NEXT(1);
+l_comc: op_comc(ins->arg, last_status); BLOCK_NEXT(1);
+l_sbit: op_sbit(ins->arg, last_status); BLOCK_NEXT(1);
+l_rbit: op_rbit(ins->arg, last_status); BLOCK_NEXT(1);
+l_tbit1: op_tbit1(ins->arg, last_status); BLOCK_NEXT(1);
+l_knez: op_knez(ins->arg, last_status); BLOCK_NEXT(1);
+l_tka: op_tka(ins->arg, last_status); BLOCK_NEXT(1);
+l_setr: op_setr(ins->arg, last_status); BLOCK_NEXT(1);
+l_rstr: op_rstr(ins->arg, last_status); BLOCK_NEXT(1);
+l_tdo: op_tdo(ins->arg, last_status); BLOCK_NEXT(1);
+l_ldx: op_ldx(ins->arg, last_status); BLOCK_NEXT(1);
+l_br: op_br(ins->arg, last_status); cpu_.add_cycles(1); return block_len;
+l_call: op_call(ins->arg, last_status); cpu_.add_cycles(1); return block_len;
+l_retn: op_retn(ins->arg, last_status); cpu_.add_cycles(1); return block_len;
+l_ldx_tcy: op_ldx_tcy(ins->arg, last_status); BLOCK_NEXT(2);
+l_ldx_tcy_tma: op_ldx_tcy_tma(ins->arg, last_status); BLOCK_NEXT(3);
+l_tcy_tma: op_tcy_tma(ins->arg, last_status); BLOCK_NEXT(2);
+l_tcy_tcmiy: op_tcy_tcmiy(ins->arg, last_status); BLOCK_NEXT(ins->len);
+l_xma_dyn: op_xma_dyn(ins->arg, last_status); BLOCK_NEXT(2);
+
+#undef BLOCK_NEXT
+#undef BLOCK_DISPATCH
+}
+
+/**
+ * Execute up to 'cycles' instructions without returning to the host,
+ * a basic block at a time. A callback can end the batch early by calling
+ * stop(), which takes effect at the end of the current block.
+ */
+unsigned long TMS1100::run(unsigned long cycles) {
+    unsigned long count = 0;
+    stop_requested_.store(false, memory_order_relaxed);
+    while (count < cycles && !stop_requested_.load(memory_order_relaxed)) {
+        WORD rom_address = (cpu_.get_ca() << 10) | (cpu_.get_pa() << 6) | cpu_.get_pc();
+        if (rom_->get_block(rom_address).block_len <= cycles - count) {
+            count += run_block(rom_address);
+        }
+        else {
+            step();
+            count++;
+        }
     }
-    setup_op_codes();
-    rom_ = rom;
-    ram_ = new BYTE[128];
-    for (int i = 0; i < 128; i++) {
-        ram_[i] = SET4(0xAA);
+    cpu_.flush_output();
+    update_idle(count);
+    return count;
+}
+
+/**
+ * Execute instructions until the cycle counter reaches 'cycle', same as
+ * run() otherwise.
+ */
+unsigned long TMS1100::run_until_cycle(unsigned long long cycle) {
+    unsigned long long now = cpu_.get_cycle();
+    if (cycle <= now) {
+        return 0;
+    }
+    unsigned long long cycles = cycle - now;
+    unsigned long count = 0;
+    // run() counts in unsigned long, which may be 32 bits
+    while (cycles > 0) {
+        unsigned long slice = cycles < ULONG_MAX ? cycles : ULONG_MAX;
+        unsigned long executed = run(slice);
+        count += executed;
+        cycles -= executed;
+        if (executed < slice) {
+            break;
+        }
     }
+    return count;
 }
 
-TMS1100::~TMS1100() {
-    delete cpu_;
-    delete ram_;   
+/**
+ * Execute instructions until 'done' returns true (checked after every
+ * instruction), stop() is called, or 'max_cycles' have been executed.
+ */
+unsigned long TMS1100::run_until(bool(*done)(TMS1100 *), unsigned long max_cycles) {
+    unsigned long count = 0;
+    stop_requested_.store(false, memory_order_relaxed);
+    while (count < max_cycles && !stop_requested_.load(memory_order_relaxed)) {
+        step();
+        count++;
+        if (done && done(this)) {
+            break;
+        }
+    }
+    cpu_.flush_output();
+    update_idle(count);
+    return count;
+}
+
+void TMS1100::update_idle(unsigned long count) {
+    unsigned long long quiet = cpu_.get_cycle() - cpu_.get_last_key_cycle();
+    bool idle = quiet >= idle_threshold_;
+    if (idle) {
+        idle_cycles_ += min((unsigned long long)count, quiet - idle_threshold_);
+    }
+    if (idle != idle_) {
+        idle_ = idle;
+        if (idle_cb_) {
+            idle_cb_(idle_ctx_, idle);
+        }
+    }
+}
+
+void TMS1100::set_idle_threshold(unsigned long threshold) {
+    idle_threshold_ = threshold;
+}
+
+void TMS1100::set_idle_cb(void(*idle_cb)(void *, bool), void *ctx) {
+    idle_cb_ = idle_cb;
+    idle_ctx_ = ctx;
+}
+
+bool TMS1100::get_idle() {
+    return idle_;
+}
+
+unsigned long long TMS1100::get_idle_cycles() {
+    return idle_cycles_;
+}
+
+void TMS1100::stop() {
+    stop_requested_.store(true, memory_order_relaxed);
+}
+
+TMS1100::TMS1100(ROM *rom) {
+    rom_ = rom;
+    stop_requested_.store(false, memory_order_relaxed);
+    idle_threshold_ = IDLE_CYCLES;
+    idle_ = false;
+    idle_cycles_ = 0;
+    idle_cb_ = NULL;
+    idle_ctx_ = NULL;
 }
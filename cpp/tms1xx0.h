@@ -9,48 +9,350 @@
 #ifndef TMS1XX0_H
 #define TMS1XX0_H
 
+#include <atomic>
+
 #define R_WIDTH 15
 
+// RAM words (4 bits each)
+#define RAM_SIZE 128
+
+// ROM address space, CA, PA and PC (11 bits). Images are padded to it.
+#define ROM_WORDS 2048
+#define ROM_MASK (ROM_WORDS - 1)
+
+// number of output events buffered before they are handed to the host
+#define OUTPUT_BUFFER_SIZE 1024
+
+// default cycles without a key press before the cpu counts as idle, ~1s
+#define IDLE_CYCLES 60000
+
 typedef unsigned char BYTE;
 typedef unsigned short WORD;
 
+/*
+ * Handler ids used by the predecoded ROM image, one per opcode handler.
+ */
+enum OpId {
+    OP_INVALID = 0,
+    OP_TAY, OP_TYA, OP_CLA,
+    OP_TAM, OP_TAMIYC, OP_TAMDYN, OP_TAMZA,
+    OP_TMY, OP_TMA, OP_XMA,
+    OP_AMAAC, OP_SAMAN, OP_IMAC, OP_DMAN, OP_A_AAC, OP_IYC, OP_DYN, OP_CPAIZ,
+    OP_ALEM,
+    OP_MNEA, OP_MNEZ, OP_YNEA,
+    OP_LDP, OP_TCY, OP_YNEC, OP_TCMIY,
+    OP_COMX, OP_COMC, OP_SBIT, OP_RBIT, OP_TBIT1,
+    OP_KNEZ, OP_TKA,
+    OP_SETR, OP_RSTR, OP_TDO,
+    OP_LDX,
+    OP_BR, OP_CALL, OP_RETN,
+
+    // fused superinstructions, only found in the block translation
+    OP_LDX_TCY,     // arg = x << 4 | y
+    OP_LDX_TCY_TMA, // arg = x << 4 | y
+    OP_TCY_TMA,     // arg = y
+    OP_TCY_TCMIY,   // arg = count << 4 | y, the TCMIY words follow
+    OP_XMA_DYN,
+    OP_COUNT
+};
+
+/*
+ * A ROM word decoded once at load time.
+ */
+struct Instruction {
+    BYTE op;        // OpId
+    BYTE arg;       // decoded constant, or the pc of a branch/call target
+    BYTE len;       // number of ROM words covered (> 1 for fused ops)
+    BYTE block_len; // number of ROM words left in the basic block
+};
+
+
+/*
+ * On-disk cache of remapped and predecoded ROM images, one file per ROM
+ * named after the content hash. The arrays are stored as they are in
+ * memory and mapped back in read-only. ROM_CACHE_VERSION changes
+ * whenever the decoder or the block translation does.
+ */
+#define ROM_CACHE_MAGIC "MRLC"
+#define ROM_CACHE_VERSION 3
+
+struct RomCacheHeader {
+    char magic[4];
+    WORD version;
+    WORD instruction_size;      // sizeof(Instruction)
+    unsigned int size;          // ROM words in the file
+    unsigned int reserved;
+    unsigned long long hash;    // of the raw ROM file
+    unsigned long long checksum; // of the three arrays below
+    // BYTE data[ROM_WORDS], Instruction code[ROM_WORDS],
+    // Instruction blocks[ROM_WORDS]
+};
 
+/*
+ * A ROM image is never written after load_rom(), so any number of cpus
+ * can share one. load_shared() hands out one reference counted image
+ * per ROM content for hosts running many sessions.
+ *
+ * Images are checked when they are loaded and padded to the whole
+ * address space, so a fetch is a masked array index. Build with
+ * TMS1100_DEBUG to trap fetches beyond the end of the loaded image.
+ */
 class ROM {
     private:
-    BYTE *data_;
-    int rom_size_;
+    const BYTE *data_;
+    const Instruction *code_;
+    const Instruction *blocks_;
+    int rom_size_;              // words in the file, the arrays have ROM_WORDS
+    unsigned long long hash_;
+    void *map_;                 // cache file the arrays point into, or NULL
+    unsigned long map_size_;
+    bool owned_;                // arrays allocated by load_rom()
+    int refs_;
+    void out_of_range(WORD index);
+    void free_image();
+    void load_image(const BYTE *raw, int size, unsigned long long hash);
+    bool load_cache(std::string path, int size, unsigned long long hash);
+    void save_cache(std::string path);
     public:
     ROM();
+    ~ROM();
     void load_rom(std::string filename);
+
+#ifdef TMS1100_EMBEDDED_ROM
+    // mp3404.bin built into the binary, remapped and decoded at compile
+    // time. No file I/O and nothing to do at run time.
+    void load_embedded();
+#endif
+
     BYTE get_data(WORD index);
+    const Instruction &get_instruction(WORD index);
+    const Instruction &get_block(WORD index);
+    // the fetch as it was before images were padded, checked against the
+    // size of the file and throwing past it. merlin_bench --fetch checked
+    // times it against get_instruction().
+    const Instruction &get_instruction_checked(WORD index);
+
+    // FNV-1a of the raw ROM file
+    unsigned long long get_hash();
+
+    // the image for the file's content, loaded by the first caller and
+    // deleted by the last release()
+    static ROM *load_shared(std::string filename);
+    void release();
+
+    // directory for cached images, created if needed. Empty (the default)
+    // turns the cache off.
+    static void set_cache_dir(std::string dir);
+};
+
+inline BYTE ROM::get_data(WORD index) {
+#ifdef TMS1100_DEBUG
+    if (index >= rom_size_) {
+        out_of_range(index);
+    }
+#endif
+    return data_[index & ROM_MASK];
+}
+
+inline const Instruction &ROM::get_instruction(WORD index) {
+#ifdef TMS1100_DEBUG
+    if (index >= rom_size_) {
+        out_of_range(index);
+    }
+#endif
+    return code_[index & ROM_MASK];
+}
+
+inline const Instruction &ROM::get_block(WORD index) {
+#ifdef TMS1100_DEBUG
+    if (index >= rom_size_) {
+        out_of_range(index);
+    }
+#endif
+    return blocks_[index & ROM_MASK];
+}
+
+inline const Instruction &ROM::get_instruction_checked(WORD index) {
+    if (index >= rom_size_) {
+        out_of_range(index);
+    }
+    return code_[index];
+}
+
+/*
+ * R/O output change, buffered while the cpu runs when a batch callback
+ * is installed.
+ */
+enum OutputType {
+    OUTPUT_R,
+    OUTPUT_O
 };
 
-class CPUState {
+struct OutputEvent {
+    unsigned long long cycle;   // instruction count when the output was written
+    BYTE type;                  // OutputType
+    BYTE index;                 // R line, 0 for O
+    BYTE value;                 // R line state or O register value
+};
+
+/*
+ * Snapshot of the whole machine for save_state()/load_state(). It is
+ * trivially copyable, so taking and restoring one is a couple of
+ * memcpy's. RAM is nibble packed, word 2n in the low nibble of ram[n].
+ */
+struct MachineState {
+    unsigned long long cycle;
+    WORD r;                 // R latch, bit n is R line n
+    BYTE a;
+    BYTE x;
+    BYTE y;
+    BYTE pa;
+    BYTE pb;
+    BYTE pc;
+    BYTE sr;
+    BYTE ca;
+    BYTE cb;
+    BYTE cs;
+    BYTE cl;
+    BYTE s;
+    BYTE sl;
+    BYTE k;
+    BYTE o;
+    BYTE ram[RAM_SIZE / 2];
+    BYTE reserved[7];       // zero, pads the struct without holes
+};
+
+/*
+ * On-disk save state: a header and the MachineState in host byte order.
+ * STATE_VERSION changes whenever MachineState does.
+ */
+#define STATE_MAGIC "MRLN"
+#define STATE_VERSION 1
+
+struct StateFile {
+    char magic[4];
+    WORD version;
+    WORD size;              // sizeof(MachineState)
+    MachineState state;
+};
+
+// throw runtime_error on a bad header
+void check_state_file(const StateFile &);
+void write_state_file(std::string filename, const MachineState &);
+void read_state_file(std::string filename, MachineState &);
+
+class OutputRing;
+
+/*
+ * Host side of the R, O and K ports. Every handler is passed 'ctx' back
+ * so a host can keep its state in an object instead of globals.
+ */
+struct IOPorts {
+    void *ctx;
+    void(*output_r)(void *ctx, int index, bool val);
+    void(*output_o)(void *ctx, int val);
+    int(*input_k)(void *ctx, int o_reg);
+};
+
+/*
+ * IOPorts for a host class with output_r(int, bool), output_o(int) and
+ * input_k(int) members. The trampolines are generated per host class, so
+ * the host's members are known at compile time and get inlined into them.
+ */
+template <class Host>
+IOPorts bind_io(Host *host) {
+    IOPorts ports;
+    ports.ctx = host;
+    ports.output_r = [](void *ctx, int index, bool val) {
+        static_cast<Host *>(ctx)->output_r(index, val);
+    };
+    ports.output_o = [](void *ctx, int val) {
+        static_cast<Host *>(ctx)->output_o(val);
+    };
+    ports.input_k = [](void *ctx, int o_reg) -> int {
+        return static_cast<Host *>(ctx)->input_k(o_reg);
+    };
+    return ports;
+}
+
+/*
+ * The register file, one byte per register in this order. Flags (cl, s,
+ * sl) are 0 or 1.
+ */
+struct Registers {
+    BYTE a;
+    BYTE cl;
+    BYTE ca;
+    BYTE cb;
+    BYTE cs;
+    BYTE k;
+    BYTE o;
+    BYTE pa;
+    BYTE pb;
+    BYTE pc;
+    BYTE s;
+    BYTE sl;
+    BYTE sr;
+    BYTE x;
+    BYTE y;
+};
+
+/*
+ * Everything an instruction touches (registers, R latch, cycle counter
+ * and the nibble packed RAM) sits at the start of the object and fits in
+ * its first two cache lines (checked by a static_assert in the
+ * constructor). The I/O configuration behind it is only read when the
+ * program does I/O.
+ */
+class alignas(64) CPUState {
     private:
-    BYTE reg_a_;
-    bool reg_cl_;
-    BYTE reg_ca_;
-    BYTE reg_cb_;
-    BYTE reg_cs_;
-    BYTE reg_k_;
-    BYTE reg_o_;
-    BYTE reg_pa_;
-    BYTE reg_pb_;
-    BYTE reg_pc_;
-    bool reg_r_[R_WIDTH];
-    bool reg_s_;
-    bool reg_sl_;
-    BYTE reg_sr_;
-    BYTE reg_x_;
-    BYTE reg_y_;
-    void(*output_r_cb_)(int, bool);
-    void(*output_o_cb_)(int);
-    int(*input_k_cb_)(int);
+    Registers reg_;
+    bool change_only_;
+    WORD reg_r_;                // bit n is R line n
+    bool muted_;
+    unsigned long long cycle_;
+    unsigned long long last_key_cycle_;
+    BYTE ram_[RAM_SIZE / 2];    // word 2n in the low nibble of ram_[n], as in MachineState
+
+    OutputRing *output_ring_;
+    void(*output_batch_cb_)(void *, const OutputEvent *, int);
+    void *output_batch_ctx_;
+    void(*output_r_cb_)(void *, int, bool);
+    void *output_r_ctx_;
+    void(*output_o_cb_)(void *, int);
+    void *output_o_ctx_;
+    int(*input_k_cb_)(void *, int);
+    void *input_k_ctx_;
+
+    // callbacks without a context, called through the plain_* adapters
+    void(*plain_r_cb_)(int, bool);
+    void(*plain_o_cb_)(int);
+    int(*plain_k_cb_)(int);
+    void(*plain_batch_cb_)(const OutputEvent *, int);
+    static void plain_r(void *, int, bool);
+    static void plain_o(void *, int);
+    static int plain_k(void *, int);
+    static void plain_batch(void *, const OutputEvent *, int);
+
+    // allocated with the first batch callback
+    OutputEvent *events_;
+    int event_count_;
+
+    void output(BYTE type, BYTE index, BYTE value);
 
     public:
     CPUState();
+    ~CPUState();
+    // not copyable: it owns events_ and the plain_* adapters are
+    // registered with 'this' as their context
+    CPUState(const CPUState &) = delete;
+    CPUState &operator=(const CPUState &) = delete;
     void increment_pc();
 
+    unsigned long long get_cycle();
+    void add_cycles(int);
+    unsigned long long get_last_key_cycle();
+
     BYTE get_pc();
     void set_pc(BYTE);
     BYTE get_pb();
@@ -96,24 +398,238 @@ class CPUState {
 
     void set_o(BYTE);
 
+    // RAM word M(X, Y)
+    BYTE get_ram();
+    void set_ram(BYTE);
+
+    // the live registers, R latch and packed RAM, for hosts that read
+    // the whole state instead of following the output
+    const Registers *get_registers();
+    const WORD *get_r_latch();
+    const BYTE *get_ram_data();
+
     void set_output_r_cb(void(*)(int, bool));
     void set_output_o_cb(void(*)(int));
     void set_input_k_cb(int(*)(int));
+    void set_output_r_cb(void(*)(void *, int, bool), void *);
+    void set_output_o_cb(void(*)(void *, int), void *);
+    void set_input_k_cb(int(*)(void *, int), void *);
+
+    void set_output_batch_cb(void(*)(const OutputEvent *, int));
+    void set_output_batch_cb(void(*)(void *, const OutputEvent *, int), void *);
+    void set_output_ring(OutputRing *);
+    void set_output_change_only(bool);
+    void set_output_muted(bool);
+    void flush_output();
+
+    void save(MachineState &);
+    void load(const MachineState &);
 };
 
+/*
+ * The register accessors are used by every opcode handler, keep them
+ * inline so they compile down to plain loads and stores.
+ */
+inline void CPUState::increment_pc() {
+    reg_.pc = (reg_.pc + 1) & 0x3F;
+}
+
+inline unsigned long long CPUState::get_cycle() {
+    return cycle_;
+}
+
+inline void CPUState::add_cycles(int count) {
+    cycle_ += count;
+}
+
+inline unsigned long long CPUState::get_last_key_cycle() {
+    return last_key_cycle_;
+}
+
+inline BYTE CPUState::get_pc() {
+    return reg_.pc;
+}
+
+inline void CPUState::set_pc(BYTE pc) {
+    reg_.pc = pc & 0x3F;
+}
+
+inline BYTE CPUState::get_pa() {
+    return reg_.pa;
+}
+
+inline void CPUState::set_pa(BYTE pa) {
+    reg_.pa = pa & 0x0F;
+}
+
+inline BYTE CPUState::get_pb() {
+    return reg_.pb;
+}
+
+inline void CPUState::set_pb(BYTE pb) {
+    reg_.pb = pb & 0x0F;
+}
+
+inline bool CPUState::get_s() {
+    return reg_.s;
+}
+
+inline void CPUState::set_s(bool val) {
+    reg_.s = val;
+}
+
+inline bool CPUState::get_sl() {
+    return reg_.sl;
+}
+
+inline void CPUState::set_sl(bool val) {
+    reg_.sl = val;
+}
+
+inline BYTE CPUState::get_sr() {
+    return reg_.sr;
+}
+
+inline void CPUState::set_sr(BYTE val) {
+    reg_.sr = val;
+}
+
+inline BYTE CPUState::get_a() {
+    return reg_.a;
+}
+
+inline void CPUState::set_a(BYTE val) {
+    reg_.a = val & 0x0F;
+}
+
+inline BYTE CPUState::get_y() {
+    return reg_.y;
+}
+
+inline void CPUState::set_y(BYTE val) {
+    reg_.y = val & 0x0F;
+}
+
+inline void CPUState::inc_y() {
+    set_y(reg_.y + 1);
+}
+
+inline void CPUState::dec_y() {
+    set_y(reg_.y - 1);
+}
+
+inline BYTE CPUState::get_x() {
+    return reg_.x;
+}
+
+inline void CPUState::set_x(BYTE val) {
+    reg_.x = val & 0x07;
+}
+
+inline void CPUState::com_x() {
+    reg_.x = (reg_.x ^ 4) & 0x07;
+}
+
+inline void CPUState::com_cb() {
+    reg_.cb = (~reg_.cb) & 0x01;
+}
+
+inline void CPUState::set_k(BYTE val) {
+    reg_.k = val & 0x0F;
+}
+
+inline const Registers *CPUState::get_registers() {
+    return &reg_;
+}
+
+inline const WORD *CPUState::get_r_latch() {
+    return &reg_r_;
+}
+
+inline const BYTE *CPUState::get_ram_data() {
+    return ram_;
+}
+
+inline BYTE CPUState::get_ram() {
+    BYTE addr = (reg_.x << 4) | reg_.y;
+    return (ram_[addr >> 1] >> ((addr & 1) << 2)) & 0x0F;
+}
+
+inline void CPUState::set_ram(BYTE val) {
+    BYTE addr = (reg_.x << 4) | reg_.y;
+    int shift = (addr & 1) << 2;
+    BYTE &word = ram_[addr >> 1];
+    word = (word & ~(0x0F << shift)) | ((val & 0x0F) << shift);
+}
+
+inline bool CPUState::get_cl() {
+    return reg_.cl;
+}
+
+inline void CPUState::set_cl(bool val) {
+    reg_.cl = val;
+}
+
+inline BYTE CPUState::get_ca() {
+    return reg_.ca;
+}
+
+inline void CPUState::set_ca(BYTE val) {
+    reg_.ca = val & 0x01;
+}
+
+inline BYTE CPUState::get_cb() {
+    return reg_.cb;
+}
+
+inline void CPUState::set_cb(BYTE val) {
+    reg_.cb = val & 0x01;
+}
+
+inline BYTE CPUState::get_cs() {
+    return reg_.cs;
+}
+
+inline void CPUState::set_cs(BYTE val) {
+    reg_.cs = val & 0x01;
+}
+
+/*
+ * A TMS1100 is a single allocation: the CPU state (registers and RAM)
+ * first, then the run/idle bookkeeping. The ROM and the handler table
+ * are shared by all instances.
+ */
 class TMS1100 {
     private:
-    CPUState *cpu_;
+    CPUState cpu_;
     ROM *rom_;
-    BYTE *ram_;
-    void(TMS1100::*op_code_func_[256])(BYTE, bool);
-    BYTE op_code_constant_[256];
+    // set by stop(), which may come from another thread
+    std::atomic<bool> stop_requested_;
+
+    unsigned long idle_threshold_;
+    bool idle_;
+    unsigned long long idle_cycles_;
+    void(*idle_cb_)(void *, bool);
+    void *idle_ctx_;
 
     void uADC_a(BYTE val);
     void uADC_y(BYTE val);
 
-    void exec(BYTE);
-    void setup_op_codes();
+    // one word for step(): a call through op_table_, or with
+    // TMS1100_SWITCH_DISPATCH a switch over the OpId. The define only
+    // picks this dispatcher, which step() and run_until() use. run() and
+    // run_until_cycle() go through run_block(), which is threaded code
+    // (a computed goto per handler) in every build.
+    void exec(const Instruction &);
+    int run_block(WORD);
+    void update_idle(unsigned long count);
+
+    // handler per OpId, for the table dispatch exec()
+    struct OpTable {
+        void(TMS1100::*func[OP_COUNT])(BYTE, bool);
+        OpTable();
+    };
+    static const OpTable op_table_;
 
     // register to register
     void op_tay(BYTE, bool);
@@ -180,14 +696,90 @@ class TMS1100 {
     void op_call(BYTE, bool);
     void op_retn(BYTE, bool);
 
+    // fused superinstructions
+    void op_ldx_tcy(BYTE, bool);
+    void op_ldx_tcy_tma(BYTE, bool);
+    void op_tcy_tma(BYTE, bool);
+    void op_tcy_tcmiy(BYTE, bool);
+    void op_xma_dyn(BYTE, bool);
+
     public:
     TMS1100(ROM *);
-    ~TMS1100();
     void step();
 
+    // batched execution, all return the number of instructions executed.
+    // One instruction is one cycle of emulated time, run() runs for
+    // 'cycles' and run_until_cycle() up to the point get_cycle() reaches
+    // 'cycle' (nothing if it is already there).
+    unsigned long run(unsigned long cycles);
+    unsigned long run_until(bool(*done)(TMS1100 *), unsigned long max_cycles);
+    unsigned long run_until_cycle(unsigned long long cycle);
+    void stop();
+
+    // number of instructions executed since reset, the emulated time.
+    // Output events carry it, a callback can read it for the instruction
+    // that is calling.
+    unsigned long long get_cycle();
+
     void set_output_r_cb(void(*)(int, bool));
     void set_output_o_cb(void(*)(int));
     void set_input_k_cb(int(*)(int));
+
+    // same with a context pointer that is passed back to the callback
+    void set_output_r_cb(void(*)(void *, int, bool), void *ctx);
+    void set_output_o_cb(void(*)(void *, int), void *ctx);
+    void set_input_k_cb(int(*)(void *, int), void *ctx);
+
+    // install all three ports at once, see bind_io()
+    void set_io(const IOPorts &);
+
+    // with a batch callback installed R/O output is buffered and handed
+    // over at the end of every run()/run_until() (or when the buffer is
+    // full) instead of calling the R/O callbacks
+    void set_output_batch_cb(void(*)(const OutputEvent *, int));
+    void set_output_batch_cb(void(*)(void *, const OutputEvent *, int), void *ctx);
+    void flush_output();
+
+    // with a ring installed R/O output is pushed to it as it happens, for
+    // a consumer on another thread. Takes precedence over the callbacks.
+    void set_output_ring(OutputRing *);
+
+    // only report R lines and O values that actually changed
+    void set_output_change_only(bool);
+
+    // drop all R/O output, the R latch and O still follow the program
+    void set_output_muted(bool);
+
+    // idle: no key has been pressed (every K read returned 0) for the last
+    // 'threshold' cycles. The Merlin ROM keeps blinking, scanning and
+    // counting while idle, so it is never skipped, but a host can poll
+    // less often. Updated at the end of run()/run_until(), the callback
+    // is called when the idle state changes.
+    void set_idle_threshold(unsigned long threshold);
+    void set_idle_cb(void(*)(void *, bool), void *ctx);
+    bool get_idle();
+
+    // cycles executed while idle since reset
+    unsigned long long get_idle_cycles();
+
+    // views of the live state, valid for the lifetime of the TMS1100. RAM
+    // is RAM_SIZE / 2 bytes packed as in MachineState.ram, X selects a
+    // row of 8 bytes and word Y is in the low nibble of byte Y / 2 when
+    // Y is even and in the high nibble when it is odd.
+    const Registers *get_registers();
+    const WORD *get_r_latch();
+    const BYTE *get_ram_data();
+
+    // snapshot/restore the registers and RAM. load_state() reports the
+    // restored R lines and O to the host so a front end can redraw.
+    void save_state(MachineState &);
+    void load_state(const MachineState &);
+    void save_state(std::string filename);
+    void load_state(std::string filename);
 };
 
+inline unsigned long long TMS1100::get_cycle() {
+    return cpu_.get_cycle();
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,252 @@
+/**
+ * @file trace.cpp
+ * @author Carl Edwards
+ *
+ * K input record/replay for the TMS1100 C++ library.
+ */
+#include <string>
+#include <cstring>
+#include <cstddef>
+#include <stdexcept>
+#include <algorithm>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "trace.h"
+
+using namespace std;
+
+static_assert(sizeof(TraceRecord) == 8, "TraceRecord has padding holes");
+static_assert(sizeof(TraceHeader) == 112, "TraceHeader has padding holes");
+
+TraceRecorder::TraceRecorder(TMS1100 *cpu, const IOPorts &host, string filename) {
+    cpu_ = cpu;
+    host_ = host;
+    filename_ = filename;
+    record_count_ = 0;
+    total_ = 0;
+    last_k_ = -1;
+
+    TraceHeader header;
+    memset(&header, 0, sizeof header);
+    memcpy(header.magic, TRACE_MAGIC, sizeof header.magic);
+    header.version = TRACE_VERSION;
+    header.record_size = sizeof(TraceRecord);
+    header.end_cycle = 0;
+    cpu_->save_state(header.start);
+
+    file_.open(filename, ios::binary | ios::out | ios::trunc);
+    if (!file_.is_open()) {
+        throw runtime_error("error opening file: " + filename);
+    }
+    file_.write((const char *)&header, sizeof header);
+    records_ = new TraceRecord[TRACE_BUFFER_SIZE];
+
+    IOPorts ports;
+    ports.ctx = this;
+    ports.output_r = output_r;
+    ports.output_o = output_o;
+    ports.input_k = input_k;
+    cpu_->set_io(ports);
+}
+
+TraceRecorder::~TraceRecorder() {
+    try {
+        close();
+    } catch (...) {
+        // nothing to be done about a failed write here
+    }
+    delete[] records_;
+}
+
+void TraceRecorder::output_r(void *ctx, int index, bool val) {
+    TraceRecorder *recorder = (TraceRecorder *)ctx;
+    if (recorder->host_.output_r) {
+        recorder->host_.output_r(recorder->host_.ctx, index, val);
+    }
+}
+
+void TraceRecorder::output_o(void *ctx, int val) {
+    TraceRecorder *recorder = (TraceRecorder *)ctx;
+    if (recorder->host_.output_o) {
+        recorder->host_.output_o(recorder->host_.ctx, val);
+    }
+}
+
+int TraceRecorder::input_k(void *ctx, int o_reg) {
+    TraceRecorder *recorder = (TraceRecorder *)ctx;
+    int k = recorder->host_.input_k ? recorder->host_.input_k(recorder->host_.ctx, o_reg) : 0;
+    k &= 0x0F;
+    if (k != recorder->last_k_) {
+        unsigned long long cycle = recorder->cpu_->get_cycle();
+        TraceRecord &record = recorder->records_[recorder->record_count_++];
+        record.cycle_lo = cycle & 0xFFFFFFFF;
+        record.cycle_hi = cycle >> 32;
+        record.o = o_reg;
+        record.k = k;
+        recorder->last_k_ = k;
+        if (recorder->record_count_ == TRACE_BUFFER_SIZE) {
+            recorder->flush();
+        }
+    }
+    return k;
+}
+
+void TraceRecorder::flush() {
+    file_.write((const char *)records_, record_count_ * sizeof(TraceRecord));
+    total_ += record_count_;
+    record_count_ = 0;
+    if (!file_) {
+        throw runtime_error("error writing file: " + filename_);
+    }
+}
+
+/*
+ * Writes out the buffered records and the end cycle, and gives the I/O
+ * ports back to the host.
+ */
+void TraceRecorder::close() {
+    if (!file_.is_open()) {
+        return;
+    }
+    cpu_->set_io(host_);
+    flush();
+    unsigned long long end_cycle = cpu_->get_cycle();
+    file_.seekp(offsetof(TraceHeader, end_cycle));
+    file_.write((const char *)&end_cycle, sizeof end_cycle);
+    file_.close();
+    if (!file_) {
+        throw runtime_error("error writing file: " + filename_);
+    }
+}
+
+unsigned long TraceRecorder::get_records() {
+    return total_ + record_count_;
+}
+
+TracePlayer::TracePlayer(TMS1100 *cpu, const IOPorts &host, string filename) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw runtime_error("error opening file: " + filename);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(TraceHeader)) {
+        ::close(fd);
+        throw runtime_error("not a trace: " + filename);
+    }
+    map_size_ = st.st_size;
+    map_ = mmap(NULL, map_size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map_ == MAP_FAILED) {
+        throw runtime_error("error mapping file: " + filename);
+    }
+
+    header_ = (const TraceHeader *)map_;
+    if (memcmp(header_->magic, TRACE_MAGIC, sizeof header_->magic) != 0
+            || header_->version != TRACE_VERSION || header_->record_size != sizeof(TraceRecord)) {
+        munmap(map_, map_size_);
+        throw runtime_error("unsupported trace: " + filename);
+    }
+    records_ = (const TraceRecord *)(header_ + 1);
+    count_ = (map_size_ - sizeof(TraceHeader)) / sizeof(TraceRecord);
+    next_ = 0;
+    k_ = 0;
+    mismatches_ = 0;
+
+    cpu_ = cpu;
+    host_ = host;
+    IOPorts ports;
+    ports.ctx = this;
+    ports.output_r = output_r;
+    ports.output_o = output_o;
+    ports.input_k = input_k;
+    cpu_->set_io(ports);
+    cpu_->load_state(header_->start);
+}
+
+TracePlayer::~TracePlayer() {
+    cpu_->set_io(host_);
+    munmap(map_, map_size_);
+}
+
+void TracePlayer::output_r(void *ctx, int index, bool val) {
+    TracePlayer *player = (TracePlayer *)ctx;
+    if (player->host_.output_r) {
+        player->host_.output_r(player->host_.ctx, index, val);
+    }
+}
+
+void TracePlayer::output_o(void *ctx, int val) {
+    TracePlayer *player = (TracePlayer *)ctx;
+    if (player->host_.output_o) {
+        player->host_.output_o(player->host_.ctx, val);
+    }
+}
+
+/*
+ * A faithful replay reads K at exactly the recorded cycles with the
+ * recorded O, anything else means the replay has diverged.
+ */
+int TracePlayer::input_k(void *ctx, int o_reg) {
+    TracePlayer *player = (TracePlayer *)ctx;
+    unsigned long long cycle = player->cpu_->get_cycle();
+    while (player->next_ < player->count_ && trace_cycle(player->records_[player->next_]) <= cycle) {
+        const TraceRecord &record = player->records_[player->next_++];
+        if (trace_cycle(record) != cycle || record.o != o_reg) {
+            player->mismatches_++;
+        }
+        player->k_ = record.k;
+    }
+    return player->k_;
+}
+
+unsigned long TracePlayer::run(unsigned long cycles) {
+    unsigned long long now = cpu_->get_cycle();
+    unsigned long long end = get_end_cycle();
+    if (now >= end) {
+        return 0;
+    }
+    return cpu_->run(min((unsigned long long)cycles, end - now));
+}
+
+unsigned long TracePlayer::run_to_end() {
+    unsigned long count = 0;
+    while (!finished()) {
+        unsigned long executed = run(1000000);
+        if (executed == 0) {
+            break;
+        }
+        count += executed;
+    }
+    return count;
+}
+
+bool TracePlayer::finished() {
+    return cpu_->get_cycle() >= get_end_cycle();
+}
+
+unsigned long long TracePlayer::get_start_cycle() {
+    return header_->start.cycle;
+}
+
+unsigned long long TracePlayer::get_end_cycle() {
+    if (header_->end_cycle != 0) {
+        return header_->end_cycle;
+    }
+    // cut short, play up to the last K change
+    return count_ > 0 ? trace_cycle(records_[count_ - 1]) : header_->start.cycle;
+}
+
+unsigned long TracePlayer::get_records() {
+    return count_;
+}
+
+unsigned long TracePlayer::get_mismatches() {
+    // records the replay went past without reading them
+    unsigned long missed = 0;
+    for (unsigned long i = next_; i < count_ && trace_cycle(records_[i]) < cpu_->get_cycle(); i++) {
+        missed++;
+    }
+    return mismatches_ + missed;
+}
@@ -0,0 +1,115 @@
+/**
+ * @file trace.h
+ * @author Carl Edwards
+ *
+ * K input record/replay for the TMS1100 C++ library.
+ *
+ * TraceRecorder logs the K input the game sees to a binary trace file and
+ * TracePlayer feeds it back through the K port without calling the host,
+ * so a session can be reproduced exactly and as fast as the host allows.
+ *
+ * Trace file layout, host byte order:
+ *   TraceHeader, with the machine state the recording started from
+ *   TraceRecord[] appended as the game runs, one per change of the K
+ *   value, sorted by cycle
+ * The records are fixed size so a trace can be mapped into memory and
+ * indexed directly. The header's end_cycle is filled in when the
+ * recording is closed, a trace cut short by a crash has end_cycle 0.
+ */
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <string>
+#include <fstream>
+#include "tms1xx0.h"
+
+#define TRACE_MAGIC "MRLT"
+#define TRACE_VERSION 1
+
+// records buffered before they are written out
+#define TRACE_BUFFER_SIZE 4096
+
+struct TraceHeader {
+    char magic[4];
+    WORD version;
+    WORD record_size;           // sizeof(TraceRecord)
+    unsigned long long end_cycle;
+    MachineState start;
+};
+
+struct TraceRecord {
+    unsigned int cycle_lo;      // cycle of the K read, 48 bits
+    WORD cycle_hi;
+    BYTE o;                     // O register at the read
+    BYTE k;                     // K value returned
+};
+
+class TraceRecorder {
+    private:
+    TMS1100 *cpu_;
+    IOPorts host_;
+    std::string filename_;
+    std::ofstream file_;
+    TraceRecord *records_;
+    int record_count_;
+    unsigned long total_;
+    int last_k_;
+
+    static void output_r(void *ctx, int index, bool val);
+    static void output_o(void *ctx, int val);
+    static int input_k(void *ctx, int o_reg);
+    void flush();
+
+    public:
+    // starts recording from the cpu's current state. The recorder owns
+    // the cpu's I/O ports until it is closed and forwards them to 'host'.
+    TraceRecorder(TMS1100 *cpu, const IOPorts &host, std::string filename);
+    ~TraceRecorder();
+
+    void close();
+    unsigned long get_records();
+};
+
+class TracePlayer {
+    private:
+    TMS1100 *cpu_;
+    IOPorts host_;
+    void *map_;
+    unsigned long map_size_;
+    const TraceHeader *header_;
+    const TraceRecord *records_;
+    unsigned long count_;
+    unsigned long next_;
+    BYTE k_;
+    unsigned long mismatches_;
+
+    static void output_r(void *ctx, int index, bool val);
+    static void output_o(void *ctx, int val);
+    static int input_k(void *ctx, int o_reg);
+
+    public:
+    // loads the trace's start state into the cpu. R/O output still goes
+    // to 'host', its K port is never called.
+    TracePlayer(TMS1100 *cpu, const IOPorts &host, std::string filename);
+    ~TracePlayer();
+
+    // run up to 'cycles' instructions, never past the end of the trace.
+    // Returns the number of instructions executed.
+    unsigned long run(unsigned long cycles);
+    unsigned long run_to_end();
+    bool finished();
+
+    unsigned long long get_start_cycle();
+    unsigned long long get_end_cycle();
+    unsigned long get_records();
+
+    // K reads that didn't line up with the trace, 0 for a faithful replay
+    unsigned long get_mismatches();
+};
+
+// record cycle, 48 bits
+inline unsigned long long trace_cycle(const TraceRecord &record) {
+    return record.cycle_lo | ((unsigned long long)record.cycle_hi << 32);
+}
+
+#endif